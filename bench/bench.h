@@ -0,0 +1,236 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+/*
+  Benchmark harness shared by the kernels of all problem sets: ps1 triad
+  and pi, the ps3 matmul, the ps5 nbodies and the proj SSSP engines. It
+  times a kernel, keeps mean +- stddev over samples after a number of
+  warm-up samples (the skipSteps of nbody), and writes one row per kernel
+  and thread count. Each row carries the flops and memory bytes of one
+  call, so it can be set against the roofline of the machine.
+
+  A kernel that can be called over and over goes through bench_measure():
+  every sample repeats the call, doubling the count as triad does, until
+  the sample lasts at least min_time. One that is driven by its own loop,
+  such as the nbody time steps, feeds its timings to bench_add() itself.
+
+  Everything else comes from the environment, so that all programs can be
+  run by one script (bench/run_all.sh) into one file:
+    BENCH_FORMAT       text (default), csv, or json (one object per line)
+    BENCH_OUT          file the rows are appended to, stdout if unset
+    BENCH_THREADS      thread counts to sweep, e.g. 1,2,4,8; the default is
+                       the OpenMP maximum
+    BENCH_PEAK_GFLOPS  machine peaks as measured by bench/peak; with them
+    BENCH_PEAK_GBS     each row reports the roofline bound and how close
+                       the kernel gets to it
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#include <sys/time.h>
+#endif
+
+#define BENCH_MAX_THREADS 64  // entries of a thread sweep
+
+typedef struct bench_stats_t {
+	int warmup;  // samples dropped before the first kept one
+	int seen;  // samples offered so far
+	int n;  // samples kept
+	long calls;  // calls per sample, of the last one kept
+	double flops, bytes;  // work of one call
+	double sum, sum2, min;  // seconds per call of the kept samples
+	double rate, rate2;  // GFLOP/s of the kept samples, GB/s if there are no flops
+} BenchStats;
+
+typedef struct bench_config_t {
+	int ready;
+	int format;  // BENCH_TEXT, BENCH_CSV, BENCH_JSON
+	FILE *out;
+	int header;  // the CSV header is out
+	double peak_gflops, peak_gbs;  // 0 when unknown
+	const char *program;
+} BenchConfig;
+
+enum { BENCH_TEXT, BENCH_CSV, BENCH_JSON };
+
+static BenchConfig bench_cfg;
+
+static inline double bench_now(void) {
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+#endif
+}
+
+// Reads the environment; program names the rows
+static inline void bench_init(const char *program) {
+	const char *fmt = getenv("BENCH_FORMAT"), *out = getenv("BENCH_OUT"), *p;
+
+	if (bench_cfg.ready) return;
+	bench_cfg.ready = 1;
+	p = program ? strrchr(program, '/') : NULL;
+	bench_cfg.program = p ? p + 1 : program ? program : "?";
+	bench_cfg.format = BENCH_TEXT;
+	if (fmt && strcmp(fmt, "csv") == 0) bench_cfg.format = BENCH_CSV;
+	else if (fmt && strcmp(fmt, "json") == 0) bench_cfg.format = BENCH_JSON;
+	else if (fmt && strcmp(fmt, "text") != 0) fprintf(stderr, "BENCH_FORMAT=%s is unknown, using text\n", fmt);
+	bench_cfg.out = stdout;
+	if (out && *out) {
+		bench_cfg.out = fopen(out, "a");
+		if (bench_cfg.out == NULL) {
+			fprintf(stderr, "Cannot append to %s, using stdout\n", out);
+			bench_cfg.out = stdout;
+		}
+		// a file that already has rows has its header too
+		else if (ftell(bench_cfg.out) > 0) bench_cfg.header = 1;
+	}
+	bench_cfg.peak_gflops = getenv("BENCH_PEAK_GFLOPS") ? atof(getenv("BENCH_PEAK_GFLOPS")) : .0;
+	bench_cfg.peak_gbs = getenv("BENCH_PEAK_GBS") ? atof(getenv("BENCH_PEAK_GBS")) : .0;
+}
+
+// Fills list with the thread counts to sweep and returns how many
+static inline int bench_threads(int list[BENCH_MAX_THREADS]) {
+	const char *env = getenv("BENCH_THREADS"), *p = env;
+	char *next;
+	long t;
+	int n = 0;
+
+	while (p && n < BENCH_MAX_THREADS) {
+		t = strtol(p, &next, 10);
+		if (next == p) break;
+		if (t > 0) list[n ++] = (int) t;
+		p = *next == ',' ? next + 1 : next;
+	}
+	if (n == 0) {
+#ifdef _OPENMP
+		list[n ++] = omp_get_max_threads();
+#else
+		list[n ++] = 1;
+#endif
+	}
+	return n;
+}
+
+static inline void bench_set_threads(int threads) {
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#else
+	(void) threads;
+#endif
+}
+
+static inline void bench_stats_init(BenchStats *s, int warmup, double flops, double bytes) {
+	memset(s, 0, sizeof(BenchStats));
+	s->warmup = warmup;
+	s->flops = flops;
+	s->bytes = bytes;
+	s->min = HUGE_VAL;
+}
+
+// Offers a sample of calls calls that took seconds in total; returns
+// whether it was kept, i.e. is past the warm-up
+static inline int bench_add(BenchStats *s, double seconds, long calls) {
+	double per = seconds / calls, work = s->flops > .0 ? s->flops : s->bytes, r;
+
+	s->seen += 1;
+	if (s->seen <= s->warmup) return 0;
+	s->n += 1;
+	s->calls = calls;
+	s->sum += per;
+	s->sum2 += per * per;
+	if (per < s->min) s->min = per;
+	r = per > .0 ? 1e-9 * work / per : .0;
+	s->rate += r;
+	s->rate2 += r * r;
+	return 1;
+}
+
+static inline double bench_mean(const BenchStats *s) {
+	return s->n ? s->sum / s->n : .0;
+}
+
+static inline double bench_sd(double sum, double sum2, int n) {
+	return n > 1 ? sqrt(fabs(sum2 / n - (sum / n) * (sum / n))) : .0;
+}
+
+// Calls fn(arg) calls times, doubling calls until a batch takes at least
+// min_time, and returns the time of that batch
+static inline double bench_calibrate(void (*fn)(void *), void *arg, double min_time, long *calls) {
+	double t0, runtime = .0;
+	long r;
+
+	*calls = 1;
+	for (;;) {
+		t0 = bench_now();
+		for (r = 0; r < *calls; ++ r) fn(arg);
+		runtime = bench_now() - t0;
+		if (runtime >= min_time) return runtime;
+		*calls *= 2;
+	}
+}
+
+// warmup + samples batches of fn(arg), each as long as min_time
+static inline void bench_measure(BenchStats *s, void (*fn)(void *), void *arg, int samples, double min_time) {
+	long calls;
+	double t;
+	int i;
+
+	for (i = 0; i < s->warmup + samples; ++ i) {
+		t = bench_calibrate(fn, arg, min_time, &calls);
+		bench_add(s, t, calls);
+	}
+}
+
+// Writes the row of kernel, with free-form params such as "N=4096", as
+// run on threads threads
+static inline void bench_report(const char *kernel, const char *params, int threads, const BenchStats *s) {
+	BenchConfig *c = &bench_cfg;
+	double mean = bench_mean(s), sd = bench_sd(s->sum, s->sum2, s->n);
+	double rate = s->n ? s->rate / s->n : .0, rate_sd = bench_sd(s->rate, s->rate2, s->n);
+	double gflops = mean > .0 ? 1e-9 * s->flops / mean : .0, gbs = mean > .0 ? 1e-9 * s->bytes / mean : .0;
+	double ai = s->bytes > .0 ? s->flops / s->bytes : .0, roof = .0, frac = .0;
+
+	bench_init(NULL);
+	// compute-bound at the flops peak, memory-bound below the ridge
+	if (s->flops > .0) {
+		roof = c->peak_gflops;
+		if (s->bytes > .0 && c->peak_gbs > .0 && (roof == .0 || ai * c->peak_gbs < roof)) roof = ai * c->peak_gbs;
+		if (roof > .0) frac = gflops / roof;
+	} else if (c->peak_gbs > .0) {
+		frac = gbs / c->peak_gbs;
+	}
+
+	if (c->format == BENCH_CSV) {
+		if (!c->header) fprintf(c->out, "program,kernel,params,threads,samples,calls,mean_s,sd_s,min_s,"
+			"flops,bytes,gflops,gflops_sd,gbs,ai,roof_gflops,roof_frac\n");
+		c->header = 1;
+		fprintf(c->out, "%s,%s,\"%s\",%d,%d,%ld,%.6e,%.6e,%.6e,%.6e,%.6e,%.3f,%.3f,%.3f,%.4f,%.3f,%.4f\n",
+			c->program, kernel, params, threads, s->n, s->calls, mean, sd, s->n ? s->min : .0,
+			s->flops, s->bytes, gflops, s->flops > .0 ? rate_sd : .0, gbs, ai, roof, frac);
+	} else if (c->format == BENCH_JSON) {
+		fprintf(c->out, "{\"program\": \"%s\", \"kernel\": \"%s\", \"params\": \"%s\", \"threads\": %d, "
+			"\"samples\": %d, \"calls\": %ld, \"mean_s\": %.6e, \"sd_s\": %.6e, \"min_s\": %.6e, "
+			"\"flops\": %.6e, \"bytes\": %.6e, \"gflops\": %.3f, \"gflops_sd\": %.3f, \"gbs\": %.3f, "
+			"\"ai\": %.4f, \"roof_gflops\": %.3f, \"roof_frac\": %.4f}\n",
+			c->program, kernel, params, threads, s->n, s->calls, mean, sd, s->n ? s->min : .0,
+			s->flops, s->bytes, gflops, s->flops > .0 ? rate_sd : .0, gbs, ai, roof, frac);
+	} else {
+		fprintf(c->out, "%s %s [%s], %d thread%s: %.4e +- %.1e s per call over %d samples",
+			c->program, kernel, params, threads, threads == 1 ? "" : "s", mean, sd, s->n);
+		if (s->flops > .0) fprintf(c->out, ", %.2f +- %.2f GFLOP/s", rate, rate_sd);
+		if (s->bytes > .0) fprintf(c->out, ", %.2f GB/s", gbs);
+		if (frac > .0) fprintf(c->out, ", %.1f%% of roofline", 100. * frac);
+		fprintf(c->out, "\n");
+	}
+	fflush(c->out);
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+  Measures the two roofs of the machine for the other benchmarks: memory
+  bandwidth with the STREAM triad a[i] = b[i] + s * c[i] over arrays well
+  beyond the last level cache, and the multiply-add peak with independent
+  chains of FMAs, enough of them to hide the FMA latency. Both are swept
+  over BENCH_THREADS and reported as rows; the best of each ends up on the
+  last line as
+
+    BENCH_PEAK_GFLOPS=... BENCH_PEAK_GBS=...
+
+  for run_all.sh to export.
+
+  Usage: peak [doubles per array], 2^25 by default (768 MB in total)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+#define FMA_CHAINS 64  // a multiple of every vector width, times the FMA latency
+#define FMA_ITERS 4096
+
+typedef struct stream_t {
+	long n;
+	double *a, *b, *c;
+} Stream;
+
+void stream_triad(void *arg) {
+	Stream *s = (Stream *) arg;
+	const double scalar = 3.0;
+	long i;
+
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < s->n; ++ i) s->a[i] = s->b[i] + scalar * s->c[i];
+}
+
+static double fma_sink;
+
+void fma_peak(void *arg) {
+	(void) arg;
+	#pragma omp parallel
+	{
+		double acc[FMA_CHAINS], x = 0.999999, y = 1e-7, sum = .0;
+		int i, j;
+
+		for (j = 0; j < FMA_CHAINS; ++ j) acc[j] = j;
+		for (i = 0; i < FMA_ITERS; ++ i) {
+			#pragma omp simd
+			for (j = 0; j < FMA_CHAINS; ++ j) acc[j] = acc[j] * x + y;
+		}
+		for (j = 0; j < FMA_CHAINS; ++ j) sum += acc[j];
+		if (sum < .0) {  // never, but the compiler cannot tell
+			#pragma omp atomic
+			fma_sink += sum;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	Stream s;
+	BenchStats st;
+	int threads[BENCH_MAX_THREADS], n_threads, k, team = 1;
+	double best_gbs = .0, best_gflops = .0;
+	char params[64];
+	long i;
+
+	bench_init(argv[0]);
+	s.n = argc > 1 ? atol(argv[1]) : 1L << 25;
+	s.a = (double *) malloc(s.n * sizeof(double));
+	s.b = (double *) malloc(s.n * sizeof(double));
+	s.c = (double *) malloc(s.n * sizeof(double));
+	if (s.n <= 0 || s.a == NULL || s.b == NULL || s.c == NULL) {
+		printf("Cannot allocate 3 arrays of %ld doubles!\n", s.n);
+		return 1;
+	}
+	// first touch by the threads that stream the pages later
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < s.n; ++ i) s.a[i] = s.b[i] = s.c[i] = 1.0;
+
+	n_threads = bench_threads(threads);
+	for (k = 0; k < n_threads; ++ k) {
+		bench_set_threads(threads[k]);
+		#pragma omp parallel
+		{
+			#pragma omp single
+			team = omp_get_num_threads();
+		}
+
+		// STREAM counts the write of a[] once: 24 bytes per element
+		bench_stats_init(&st, 1, 2.0 * s.n, 24.0 * s.n);
+		bench_measure(&st, stream_triad, &s, 5, 0.2);
+		sprintf(params, "N=%ld", s.n);
+		bench_report("stream_triad", params, team, &st);
+		if (1e-9 * st.bytes / st.min > best_gbs) best_gbs = 1e-9 * st.bytes / st.min;
+
+		bench_stats_init(&st, 1, 2.0 * FMA_CHAINS * FMA_ITERS * team, .0);
+		bench_measure(&st, fma_peak, NULL, 5, 0.2);
+		sprintf(params, "chains=%d", FMA_CHAINS);
+		bench_report("fma_peak", params, team, &st);
+		if (1e-9 * st.flops / st.min > best_gflops) best_gflops = 1e-9 * st.flops / st.min;
+	}
+
+	printf("BENCH_PEAK_GFLOPS=%.1f BENCH_PEAK_GBS=%.1f\n", best_gflops, best_gbs);
+	free(s.a);
+	free(s.b);
+	free(s.c);
+	return fma_sink > .0;
+}
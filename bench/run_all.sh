@@ -0,0 +1,43 @@
+#!/bin/bash
+#PBS -l procs=8,tpn=8,mem=34gb,walltime=2:00:00
+#PBS -N bench
+#PBS -r n
+#PBS -j oe
+
+# Runs every kernel that reports through bench.h into one file, with the
+# roofline peaks of this machine measured first. Set GRAPH to a DIMACS .gr
+# file to include the proj SSSP engines, BENCH_THREADS to change the sweep.
+
+module load Langs/Intel/15 MPI/OpenMPI/1.8.6-intel15
+cd ${PBS_O_WORKDIR:-$(dirname "$0")}
+BENCH=$(pwd)
+
+export BENCH_FORMAT=${BENCH_FORMAT:-csv}
+export BENCH_OUT=${BENCH_OUT:-$BENCH/results.$BENCH_FORMAT}
+THREADS=${BENCH_THREADS:-1,2,4,8}
+rm -f $BENCH_OUT
+
+make peak
+export $(BENCH_THREADS=$THREADS ./peak | tail -1)
+echo "Peaks: $BENCH_PEAK_GFLOPS GFLOP/s, $BENCH_PEAK_GBS GB/s"
+
+# serial kernels
+(cd ../ps1/hw1-1 && make && ./pi_4)
+(cd ../ps1/hw1-2 && make && ./triad)
+(cd ../ps5 && make clean && make TARGETS=nbody0 TARGETOBJECTS=nbody0.o && ./nbody0)
+(cd ../ps5 && make clean && make TARGETS=nbody1 TARGETOBJECTS=nbody1.o && ./nbody1)
+
+# OpenMP kernels, over the thread sweep
+(cd ../ps3/Task1 && make serial && BENCH_THREADS=$THREADS ./serial)
+(cd ../ps5 && make clean && make TARGETS=nbody3 TARGETOBJECTS=nbody3.o && ./nbody3)  # always 8 threads
+for v in 2 4 5; do
+	(cd ../ps5 && make clean && make TARGETS=nbody$v TARGETOBJECTS=nbody$v.o)
+	for t in ${THREADS//,/ }; do
+		(cd ../ps5 && OMP_NUM_THREADS=$t ./nbody$v 16384 $t)
+	done
+done
+if [ -n "$GRAPH" ]; then
+	(cd ../proj && make bench && BENCH_THREADS=$THREADS ./bench $GRAPH)
+fi
+
+echo "Results in $BENCH_OUT"
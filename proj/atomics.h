@@ -0,0 +1,43 @@
+#ifndef PROJ_ATOMICS_H
+#define PROJ_ATOMICS_H
+
+#include <stdlib.h>
+
+#include "vertex_state.h"
+
+// Lowers *addr to val unless it already holds something smaller. Returns
+// true if this call made the update.
+inline bool atomic_min(int *addr, int val) {
+    int old = *addr;
+    while (val < old) {
+        if (__sync_bool_compare_and_swap(addr, old, val)) return true;
+        old = *addr;
+    }
+    return false;
+}
+
+// One bit per vertex, set and cleared without locks.
+class AtomicBitmap {
+public:
+    AtomicBitmap(long n) : words((n + 63) / 64, 0UL) {}
+
+    bool test(long i) const { return (words.data[i / 64] >> (i % 64)) & 1UL; }
+
+    // Sets bit i and returns true if it was clear before.
+    bool test_and_set(long i) {
+        const unsigned long mask = 1UL << (i % 64);
+        return (__sync_fetch_and_or(&words.data[i / 64], mask) & mask) == 0;
+    }
+
+    void clear(long i) {
+        __sync_fetch_and_and(&words.data[i / 64], ~(1UL << (i % 64)));
+    }
+
+private:
+    VertexArray<unsigned long> words;
+
+    AtomicBitmap(const AtomicBitmap&);
+    AtomicBitmap& operator=(const AtomicBitmap&);
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+#include <omp.h>
+#include <vector>
+#include <queue>
+
+#include "graph.h"
+#include "graph_cache.h"
+#include "reorder.h"
+#include "sssp_serial.h"
+
+#define LANES 8
+#define LANE_INF (INT_MAX / 2)
+#define SAMPLE_STRIDE 1000
+
+using namespace std;
+
+// Reads source ids from a whitespace separated list, or from the "s id"
+// lines of a DIMACS .ss file; other lines ("c", "p aux") are skipped.
+bool read_sources(const char *path, int nNodes, vector<int>& sources) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) return false;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *p = line;
+        if (*p == 's') {
+            ++ p;
+        } else if (!isdigit(*p) && *p != ' ' && *p != '\t') {
+            continue;
+        }
+        char *next;
+        for (long v = strtol(p, &next, 10); next != p; v = strtol(p, &next, 10)) {
+            if (v < 1 || v > nNodes) {
+                printf("\nSource %ld is out of range 1..%d!\n", v, nNodes);
+                exit(1);
+            }
+            sources.push_back((int) v);
+            p = next;
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+// Moore from LANES sources in one traversal. dist holds the LANES distances
+// of a vertex next to each other, so relaxing an arc is one vectorizable
+// min over the lanes, and each arc is scanned once for the whole group
+// instead of once per source. A vertex is queued when any lane improved.
+void moore_lanes(const int sources[], int nSources, int nNodes, int dist[],
+                 const CSRGraph& g, SSSPScratch& s) {
+    VertexBitset& in_queue = s.flags;
+    queue<int>& fifo_q = s.fifo_q;
+    for (long i = 0; i < (long) (nNodes + 1) * LANES; ++ i) {
+        dist[i] = LANE_INF;
+    }
+    in_queue.clear_all();
+    for (int l = 0; l < nSources; ++ l) {
+        dist[(long) sources[l] * LANES + l] = 0;
+        if (!in_queue.test(sources[l])) {
+            fifo_q.push(sources[l]);
+            in_queue.set(sources[l]);
+        }
+    }
+
+    long scanned = 0;
+    while (fifo_q.size() > 0) {
+        const int vi = fifo_q.front();
+        in_queue.clear(vi);
+        fifo_q.pop();
+        scanned += g.degree(vi);
+        const int *di = &dist[(long) vi * LANES];
+
+        for (long j = g.offsets[vi]; j < g.offsets[vi + 1]; ++ j) {
+            const int vj = g.targets[j];
+            const int w = g.weights[j];
+            int *dj = &dist[(long) vj * LANES];
+            int improved = 0;
+            #pragma omp simd reduction(|:improved)
+            for (int l = 0; l < LANES; ++ l) {
+                const int new_dist = di[l] + w;
+                const int lower = new_dist < dj[l];
+                dj[l] = lower ? new_dist : dj[l];
+                improved |= lower;
+            }
+            if (improved && !in_queue.test(vj) && g.degree(vj) > 0) {
+                fifo_q.push(vj);
+                in_queue.set(vj);
+            }
+        }
+    }
+    count_arcs(scanned);
+}
+
+// Usage: batch graph.gr sources [moore|dijkstra|radix|lanes] [-r bfs|rcm|degree]
+// Answers every source in the list in one process. The graph is loaded once
+// and each thread reuses its own dist array and scratch across the queries
+// it picks up; lanes additionally packs LANES sources into one traversal.
+int main(int argc, const char** argv) {
+    VertexOrder order(take_reorder_option(argc, argv));
+    const char *engine = argc > 3 ? argv[3] : "moore";
+    const bool lanes = strcmp(engine, "lanes") == 0;
+    sssp_engine solve = find_engine(engine);
+    if (solve == NULL && !lanes) {
+        printf("\nUnknown engine %s, expected moore, dijkstra, radix or lanes!\n", engine);
+        exit(1);
+    }
+
+    CSRGraph input, reordered;
+    double tLoad = omp_get_wtime();
+    if (argc <= 2 || !load_graph(argv[1], input)) {
+        printf("\nArgument number error or file does not exist!\n");
+        getchar();
+        exit(1);
+    }
+    tLoad = omp_get_wtime() - tLoad;
+    double tReorder = omp_get_wtime();
+    const CSRGraph& g = order.apply(input, reordered);
+    tReorder = omp_get_wtime() - tReorder;
+    const int nNodes = g.nNodes;
+    printf("nNodes = %d, nArcs = %ld\n", g.nNodes, g.nArcs);
+
+    vector<int> sources;
+    if (!read_sources(argv[2], nNodes, sources)) {
+        printf("\nSource list %s does not exist!\n", argv[2]);
+        exit(1);
+    }
+    const int nSources = sources.size();
+    printf("nSources = %d, threads = %d\n", nSources, omp_get_max_threads());
+
+    // Only the sampled distances the other targets print are kept per source
+    vector<int> samples;
+    for (int i = 1; i < nNodes; i += SAMPLE_STRIDE) samples.push_back(i);
+    samples.push_back(nNodes);
+    const int nSamples = samples.size();
+    vector<int> results((long) nSources * nSamples);
+
+    // Queries run on the reordered ids; results are read back through them
+    vector<int> query(nSources), probe(nSamples);
+    for (int s = 0; s < nSources; ++ s) query[s] = order.to_new(sources[s]);
+    for (int i = 0; i < nSamples; ++ i) probe[i] = order.to_new(samples[i]);
+
+    const int group = lanes ? LANES : 1;
+    const int nGroups = (nSources + group - 1) / group;
+
+    double tStart = omp_get_wtime(); // Start timing
+    #pragma omp parallel
+    {
+        // Per-thread state is first touched by its owner, not spread
+        SSSPScratch scratch(nNodes, false);
+        VertexArray<int> dist((long) (nNodes + 1) * group, LANE_INF, false);
+
+        #pragma omp for schedule(dynamic, 1)
+        for (int k = 0; k < nGroups; ++ k) {
+            const int first = k * group;
+            const int count = min(group, nSources - first);
+            if (lanes) {
+                moore_lanes(&query[first], count, nNodes, dist, g, scratch);
+            } else {
+                solve(query[first], nNodes, dist, g, scratch);
+            }
+            for (int l = 0; l < count; ++ l) {
+                int *out = &results[(long) (first + l) * nSamples];
+                for (int i = 0; i < nSamples; ++ i) {
+                    const int d = dist[(long) probe[i] * group + l];
+                    out[i] = (lanes && d == LANE_INF) ? INF : d;
+                }
+            }
+        }
+    } // end of parallel section
+    double tEnd = omp_get_wtime(); // End timing
+
+    for (int s = 0; s < nSources; ++ s) {
+        for (int i = 0; i < nSamples; ++ i) {
+            printf("d(%d, %d) = %d\n", sources[s], samples[i], results[(long) s * nSamples + i]);
+        }
+    }
+    printf("\nTook %.3lf s to load the graph.\n", tLoad);
+    if (order.enabled()) printf("Took %.3lf s to reorder the graph.\n", tReorder);
+    printf("Took %.3lf s to compute %d sources with %s (%.1lf sources/s).\n",
+           tEnd - tStart, nSources, engine, nSources / (tEnd - tStart));
+
+    return 0;
+}
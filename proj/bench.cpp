@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <vector>
+
+#include "graph.h"
+#include "graph_cache.h"
+#include "reorder.h"
+#include "vertex_state.h"
+#include "sssp.h"
+#include "sssp_serial.h"
+#include "sssp_parallel.h"
+#include "bench.h"
+
+using namespace std;
+
+// Every single-source engine behind one signature. The serial ones run at
+// one thread only; the others are swept over the requested thread counts.
+class BenchEngine {
+public:
+    const char *name;
+    bool parallel;
+    void (*run)(int source, const CSRGraph& g, int dist[], SSSPScratch& s);
+};
+
+void run_moore(int source, const CSRGraph& g, int dist[], SSSPScratch& s) { moore(source, g.nNodes, dist, g, s); }
+void run_dijkstra(int source, const CSRGraph& g, int dist[], SSSPScratch& s) { dijkstra(source, g.nNodes, dist, g, s); }
+void run_radix(int source, const CSRGraph& g, int dist[], SSSPScratch& s) { dijkstra_radix(source, g.nNodes, dist, g, s); }
+void run_parallel1(int source, const CSRGraph& g, int dist[], SSSPScratch&) { moore_parallel1(source, g.nNodes, dist, g); }
+void run_parallel2(int source, const CSRGraph& g, int dist[], SSSPScratch&) { moore_parallel2(source, g.nNodes, dist, g); }
+void run_parallel3(int source, const CSRGraph& g, int dist[], SSSPScratch&) { moore_parallel3(source, g.nNodes, dist, g); }
+
+static int bench_delta = 0;
+void run_deltastep(int source, const CSRGraph& g, int dist[], SSSPScratch&) { delta_stepping(source, g.nNodes, dist, g, bench_delta); }
+
+static const BenchEngine engines[] = {
+    { "moore", false, run_moore },
+    { "dijkstra", false, run_dijkstra },
+    { "radix", false, run_radix },
+    { "parallel1", true, run_parallel1 },
+    { "parallel2", true, run_parallel2 },
+    { "parallel3", true, run_parallel3 },
+    { "deltastep", true, run_deltastep },
+};
+static const int nEngines = sizeof(engines) / sizeof(engines[0]);
+
+// One solve, for the bench.h calibration loop
+struct BenchCall {
+    const BenchEngine *engine;
+    int source;
+    const CSRGraph *g;
+    int *dist;
+    SSSPScratch *scratch;
+};
+
+void bench_call(void *arg) {
+    BenchCall *c = (BenchCall *) arg;
+    c->engine->run(c->source, *c->g, c->dist, *c->scratch);
+}
+
+// Bytes a scanned arc moves: its target and weight, and the target's distance
+#define BYTES_PER_ARC 12.0
+
+// Parses a comma separated thread list such as "1,2,4,8".
+vector<int> parse_threads(const char *list) {
+    vector<int> threads;
+    const char *p = list;
+    char *next;
+    for (long t = strtol(p, &next, 10); next != p; t = strtol(p, &next, 10)) {
+        if (t < 1) {
+            printf("\nThread counts must be positive!\n");
+            exit(1);
+        }
+        threads.push_back((int) t);
+        p = (*next == ',') ? next + 1 : next;
+    }
+    return threads;
+}
+
+// Usage: bench [-t 1,2,4] [-m seconds] [-s source] [-e engine] [-r bfs|rcm|degree] graph.gr ...
+// Writes one CSV row per graph, engine and thread count to stdout. Each
+// configuration is repeated, doubling the count as triad does, until one
+// batch of runs takes at least the target time; the row reports the mean
+// solve time of that batch, the arcs scanned per run and MTEPS. Every
+// engine's dist array is checked against radix Dijkstra. When BENCH_OUT is
+// set, the rows also go there in the format of bench/bench.h, next to the
+// other kernels of the repository; BENCH_THREADS stands in for -t.
+int main(int argc, const char** argv) {
+    VertexOrder order(take_reorder_option(argc, argv));
+    vector<int> threads;
+    double target = 1.0;
+    int source = 1;
+    const char *only = NULL;
+    vector<const char*> graphs;
+
+    for (int i = 1; i < argc; ++ i) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = parse_threads(argv[++ i]);
+        else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) target = atof(argv[++ i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) source = atoi(argv[++ i]);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) only = argv[++ i];
+        else graphs.push_back(argv[i]);
+    }
+    if (graphs.empty()) {
+        printf("\nArgument number error: no graph given!\n");
+        exit(1);
+    }
+    bench_init(argv[0]);
+    if (threads.empty() && getenv("BENCH_THREADS")) {
+        int list[BENCH_MAX_THREADS];
+        threads.assign(list, list + bench_threads(list));
+    }
+    if (threads.empty()) {
+        for (int t = 1; t < omp_get_max_threads(); t *= 2) threads.push_back(t);
+        threads.push_back(omp_get_max_threads());
+    }
+
+    printf("graph,nNodes,nArcs,engine,threads,load_s,reorder_s,runs,solve_s,arcs_scanned,mteps,agree\n");
+    bool allAgree = true;
+
+    for (size_t k = 0; k < graphs.size(); ++ k) {
+        CSRGraph input, reordered;
+        double tLoad = omp_get_wtime();
+        if (!load_graph(graphs[k], input)) {
+            fprintf(stderr, "Graph %s does not exist, skipped\n", graphs[k]);
+            continue;
+        }
+        tLoad = omp_get_wtime() - tLoad;
+        double tReorder = omp_get_wtime();
+        const CSRGraph& g = order.apply(input, reordered);
+        tReorder = omp_get_wtime() - tReorder;
+        const int nNodes = g.nNodes;
+        if (source < 1 || source > nNodes) {
+            fprintf(stderr, "Source %d is out of range for %s, skipped\n", source, graphs[k]);
+            continue;
+        }
+        const int s = order.to_new(source);
+        bench_delta = default_delta(g);
+
+        SSSPScratch scratch(nNodes);
+        VertexArray<int> expect(nNodes + 1, INF), dist(nNodes + 1, INF);
+        run_radix(s, g, expect, scratch);
+
+        for (int e = 0; e < nEngines; ++ e) {
+            if (only != NULL && strcmp(only, engines[e].name) != 0) continue;
+            for (size_t ti = 0; ti < threads.size(); ++ ti) {
+                if (!engines[e].parallel && ti > 0) break;
+                const int nthreads = engines[e].parallel ? threads[ti] : 1;
+                omp_set_num_threads(nthreads);
+
+                engines[e].run(s, g, dist, scratch); // warm-up, not timed
+                BenchCall call = { &engines[e], s, &g, dist, &scratch };
+                long repeat;
+                sssp_arcs_scanned = 0;
+                const double runtime = bench_calibrate(bench_call, &call, target, &repeat);
+                // the batches before the last one ran repeat - 1 solves
+                const long scanned = sssp_arcs_scanned / (2 * repeat - 1) * repeat;
+
+                int mismatch = 0;
+                for (int v = 1; v <= nNodes; ++ v) {
+                    if (dist[v] != expect[v]) mismatch ++;
+                }
+                if (mismatch > 0) {
+                    fprintf(stderr, "%s on %s with %d threads: %d distances differ from radix\n",
+                            engines[e].name, graphs[k], nthreads, mismatch);
+                    allAgree = false;
+                }
+
+                const double solve = runtime / repeat;
+                const long perRun = scanned / repeat;
+                if (getenv("BENCH_OUT")) {
+                    BenchStats st;
+                    char params[256];
+                    bench_stats_init(&st, 0, 0., BYTES_PER_ARC * perRun);
+                    bench_add(&st, runtime, repeat);
+                    snprintf(params, sizeof(params), "graph=%s", graphs[k]);
+                    bench_report(engines[e].name, params, nthreads, &st);
+                }
+                printf("%s,%d,%ld,%s,%d,%.6lf,%.6lf,%ld,%.6lf,%ld,%.2lf,%s\n",
+                       graphs[k], nNodes, g.nArcs, engines[e].name, nthreads, tLoad,
+                       order.enabled() ? tReorder : 0., repeat, solve, perRun,
+                       perRun / solve / 1e6, mismatch == 0 ? "yes" : "no");
+                fflush(stdout);
+            }
+        }
+    }
+    return allAgree ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <vector>
+
+#include "graph.h"
+#include "graph_cache.h"
+#include "reorder.h"
+#include "vertex_state.h"
+#include "sssp_parallel.h"
+
+using namespace std;
+
+// Usage: deltastep graph.gr [delta] [-r bfs|rcm|degree]
+int main(int argc, const char** argv) {
+    VertexOrder order(take_reorder_option(argc, argv));
+    CSRGraph input, reordered;
+    double tLoad = omp_get_wtime();
+    if (argc <= 1 || !load_graph(argv[1], input)) {
+        printf("\nArgument number error or file does not exist!\n");
+        getchar();
+        exit(1);
+    }
+
+    tLoad = omp_get_wtime() - tLoad;
+    double tReorder = omp_get_wtime();
+    const CSRGraph& g = order.apply(input, reordered);
+    tReorder = omp_get_wtime() - tReorder;
+    const int nNodes = g.nNodes;
+    printf("nNodes = %d, nArcs = %ld\n", g.nNodes, g.nArcs);
+
+    const int delta = argc > 2 ? atoi(argv[2]) : default_delta(g);
+    if (delta <= 0) {
+        printf("\nDelta must be a positive integer!\n");
+        exit(1);
+    }
+    printf("delta = %d, threads = %d\n", delta, omp_get_max_threads());
+
+    VertexArray<int> dist(nNodes + 1, INF);
+    int source = 1;
+    double tStart = omp_get_wtime(); // Start timing
+    delta_stepping(order.to_new(source), nNodes, dist, g, delta);
+    double tEnd = omp_get_wtime(); // End timing
+    order.to_original(dist, nNodes);
+
+    for (int i = 1; i < nNodes; i += 1000) {
+        printf("d(%d, %d) = %d\n", source, i, dist[i]);
+    }
+    printf("d(%d, %d) = %d\n", source, nNodes, dist[nNodes]);
+    printf("\nTook %.3lf s to load the graph.\n", tLoad);
+    if (order.enabled()) printf("Took %.3lf s to reorder the graph.\n", tReorder);
+    printf("Took %.3lf s to compute.\n", tEnd - tStart);
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#ifndef PROJ_DIMACS_H
+#define PROJ_DIMACS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+// Loader for DIMACS shortest-path (.gr) files. The file is memory-mapped and
+// the arc section is split into byte ranges handed out to OpenMP threads.
+// Each range is parsed twice: the first pass counts degrees, the second scatters the
+// arcs into the CSR arrays, so no intermediate arc list is ever built.
+// Header and comment lines may appear in any order before the arcs.
+
+inline const char* dimacs_next_line(const char *p, const char *end) {
+    while (p < end && *p != '\n') ++ p;
+    return p < end ? p + 1 : end;
+}
+
+inline const char* dimacs_parse_long(const char *p, const char *end, long *out) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++ p;
+    bool neg = false;
+    if (p < end && *p == '-') {
+        neg = true;
+        ++ p;
+    }
+    long val = 0;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        val = val * 10 + (*p - '0');
+        ++ p;
+    }
+    if (p == digits) {
+        printf("\nMalformed DIMACS line: expected an integer!\n");
+        exit(1);
+    }
+    *out = neg ? -val : val;
+    return p;
+}
+
+// Parses the next "a src dst weight" line in [p, end), skipping any other
+// line before it. Returns the start of the line after it, or NULL if there
+// is no arc left.
+inline const char* dimacs_next_arc(const char *p, const char *end, int nNodes,
+                                   long *src, long *dst, long *w) {
+    while (p < end && *p != 'a') p = dimacs_next_line(p, end);
+    if (p >= end) return NULL;
+    p = dimacs_parse_long(p + 1, end, src);
+    p = dimacs_parse_long(p, end, dst);
+    p = dimacs_parse_long(p, end, w);
+    if (*src < 1 || *src > nNodes || *dst < 1 || *dst > nNodes) {
+        printf("\nArc (%ld, %ld) is out of range 1..%d!\n", *src, *dst, nNodes);
+        exit(1);
+    }
+    return dimacs_next_line(p, end);
+}
+
+// Parses every arc in [p, end). Without a cursor it only bumps the degree
+// counts in g.offsets[v + 1]; with one it stores both arc directions at the
+// slots claimed from cursor[v]. Returns the arcs seen.
+inline long dimacs_scan_arcs(const char *p, const char *end, CSRGraph& g, long cursor[]) {
+    long count = 0, src, dst, w;
+    while ((p = dimacs_next_arc(p, end, g.nNodes, &src, &dst, &w)) != NULL) {
+        ++ count;
+
+        if (cursor == NULL) {
+            #pragma omp atomic
+            g.offsets[src + 1] ++;
+            #pragma omp atomic
+            g.offsets[dst + 1] ++;
+        } else {
+            long k;
+            #pragma omp atomic capture
+            k = cursor[src] ++;
+            g.targets[k] = (int) dst;
+            g.weights[k] = (int) w;
+            #pragma omp atomic capture
+            k = cursor[dst] ++;
+            g.targets[k] = (int) src;
+            g.weights[k] = (int) w;
+        }
+    }
+    return count;
+}
+
+// Start of byte range r out of nRanges in the arc section, moved forward to
+// the next line start so no line is split between two ranges.
+inline const char* dimacs_range_start(const char *body, const char *end, int r, int nRanges) {
+    if (r == 0) return body;
+    if (r == nRanges) return end;
+    const char *p = body + (end - body) / nRanges * r;
+    if (p[-1] == '\n') return p;
+    return dimacs_next_line(p, end);
+}
+
+// Sorts the neighbors of v by target id. The atomic scatter fills a vertex's
+// slots in a thread-dependent order; sorting makes the layout (and so the
+// traversal order of every solver) the same from run to run.
+inline void dimacs_sort_neighbors(CSRGraph& g, int v) {
+    const long lo = g.offsets[v], hi = g.offsets[v + 1];
+    if (hi - lo <= 16) {
+        for (long i = lo + 1; i < hi; ++ i) {
+            const int t = g.targets[i], w = g.weights[i];
+            long j = i - 1;
+            while (j >= lo && (g.targets[j] > t || (g.targets[j] == t && g.weights[j] > w))) {
+                g.targets[j + 1] = g.targets[j];
+                g.weights[j + 1] = g.weights[j];
+                -- j;
+            }
+            g.targets[j + 1] = t;
+            g.weights[j + 1] = w;
+        }
+        return;
+    }
+    std::vector<std::pair<int, int> > arcs(hi - lo);
+    for (long i = lo; i < hi; ++ i) arcs[i - lo] = std::make_pair(g.targets[i], g.weights[i]);
+    std::sort(arcs.begin(), arcs.end());
+    for (long i = lo; i < hi; ++ i) {
+        g.targets[i] = arcs[i - lo].first;
+        g.weights[i] = arcs[i - lo].second;
+    }
+}
+
+// Reads the "p sp nNodes nArcs" header, after any comment lines, and returns
+// the start of the line after it.
+inline const char* dimacs_header(const char *p, const char *end, const char *path,
+                                 long *nNodes, long *nArcs) {
+    while (p < end && *p != 'p') p = dimacs_next_line(p, end);
+    if (p + 4 > end || p[1] != ' ' || p[2] != 's' || p[3] != 'p') {
+        printf("\nMissing \"p sp\" header in %s!\n", path);
+        exit(1);
+    }
+    p = dimacs_parse_long(p + 4, end, nNodes);
+    p = dimacs_parse_long(p, end, nArcs);
+    return dimacs_next_line(p, end);
+}
+
+// Loads a DIMACS .gr file into g. Returns false if the file cannot be opened
+// or mapped; malformed contents are reported and abort the program.
+inline bool load_dimacs(const char *path, CSRGraph& g) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const char *end = (const char*) map + size;
+    long nNodes, nArcs;
+    const char *body = dimacs_header((const char*) map, end, path, &nNodes, &nArcs);
+    g.allocate((int) nNodes, nArcs);
+
+    // A few ranges per thread so uneven line lengths do not leave threads idle
+    const int nRanges = 4 * omp_get_max_threads();
+    long nParsed = 0;
+
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:nParsed)
+    for (int r = 0; r < nRanges; ++ r) {
+        nParsed += dimacs_scan_arcs(dimacs_range_start(body, end, r, nRanges),
+                                    dimacs_range_start(body, end, r + 1, nRanges), g, NULL);
+    }
+    if (nParsed != nArcs) {
+        printf("\nHeader announces %ld arcs but %s has %ld!\n", nArcs, path, nParsed);
+        exit(1);
+    }
+
+    long *cursor = (long*) malloc((nNodes + 1) * sizeof(long));
+    for (int v = 1; v <= g.nNodes; ++ v) {
+        g.offsets[v + 1] += g.offsets[v];
+        cursor[v] = g.offsets[v];
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int r = 0; r < nRanges; ++ r) {
+        dimacs_scan_arcs(dimacs_range_start(body, end, r, nRanges),
+                         dimacs_range_start(body, end, r + 1, nRanges), g, cursor);
+    }
+
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (int v = 1; v <= g.nNodes; ++ v) {
+        dimacs_sort_neighbors(g, v);
+    }
+
+    free(cursor);
+    munmap(map, size);
+    return true;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include <vector>
+
+#include "graph.h"
+#include "reorder.h"
+#include "vertex_state.h"
+#include "sssp_mpi.h"
+
+using namespace std;
+
+// Usage: mpirun -n P distributed graph.gr [delta] [block|edges]
+// Every rank loads only the arcs of its own vertex range (see
+// load_local_graph), so the graph only has to fit in the memory of all the
+// ranks together; rank 0 gathers the sampled distances for output.
+// Reordering needs the whole graph and is not offered here.
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv); // Required MPI initialization call
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    if (VertexOrder(take_reorder_option(argc, (const char**) argv)).enabled()) {
+        if (rank == 0) printf("\nReordering (-r) is not supported by the distributed solver!\n");
+        MPI_Finalize();
+        exit(1);
+    }
+    const char *split = argc > 3 ? argv[3] : "edges";
+    if (strcmp(split, "block") != 0 && strcmp(split, "edges") != 0) {
+        if (rank == 0) printf("\nUnknown partitioning %s, expected block or edges!\n", split);
+        MPI_Finalize();
+        exit(1);
+    }
+
+    Partition part(size);
+    LocalGraph lg;
+    double tLoad = MPI_Wtime();
+    if (argc <= 1 || !load_local_graph(argv[1], strcmp(split, "edges") == 0, part, lg, MPI_COMM_WORLD)) {
+        if (rank == 0) printf("\nArgument number error or file does not exist!\n");
+        MPI_Finalize();
+        exit(1);
+    }
+    tLoad = MPI_Wtime() - tLoad;
+    const int nNodes = lg.nNodes;
+    const long nArcs = lg.nArcs;
+
+    const int delta = argc > 2 ? atoi(argv[2]) : default_delta_mpi(lg, MPI_COMM_WORLD);
+    if (delta <= 0) {
+        if (rank == 0) printf("\nDelta must be a positive integer!\n");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if (rank == 0) {
+        printf("nNodes = %d, nArcs = %ld\n", nNodes, nArcs);
+        printf("delta = %d, ranks = %d, %s partitioning\n", delta, size, split);
+    }
+    for (int r = 0; r < size; ++ r) {
+        if (r == rank) {
+            printf("rank %d: vertices %d..%d, %ld arcs\n", rank, part.first[rank],
+                   part.first[rank + 1] - 1, lg.offsets[lg.nLocal]);
+            fflush(stdout);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    VertexArray<int> dist(lg.nLocal, INF);
+    int source = 1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double tStart = MPI_Wtime(); // Start timing
+    long scanned = delta_stepping_mpi(source, lg, part, dist, delta, MPI_COMM_WORLD);
+    double tEnd = MPI_Wtime(); // End timing
+
+    long totalScanned = 0;
+    MPI_Reduce(&scanned, &totalScanned, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Only the printed distances (every 1000th vertex and the last) go to
+    // rank 0; the ranges are in rank order, so they arrive sorted
+    vector<int> sample;
+    for (int i = 0; i < lg.nLocal; ++ i) {
+        const int v = lg.first + i;
+        if ((v - 1) % 1000 == 0 || v == nNodes) {
+            sample.push_back(v);
+            sample.push_back(dist[i]);
+        }
+    }
+    int count = sample.size();
+    vector<int> counts(size), displs(size, 0);
+    MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, MPI_COMM_WORLD);
+    for (int r = 1; r < size; ++ r) displs[r] = displs[r - 1] + counts[r - 1];
+    vector<int> all(rank == 0 ? displs[size - 1] + counts[size - 1] + 1 : 1);
+    MPI_Gatherv(sample.empty() ? NULL : &sample[0], count, MPI_INT, &all[0],
+                &counts[0], &displs[0], MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        for (size_t k = 0; k + 1 < all.size(); k += 2) {
+            printf("d(%d, %d) = %d\n", source, all[k], all[k + 1]);
+        }
+        printf("\nTook %.3lf s to load and partition the graph.\n", tLoad);
+        printf("Took %.3lf s to compute (%.2lf MTEPS).\n", tEnd - tStart,
+               totalScanned / (tEnd - tStart) / 1e6);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
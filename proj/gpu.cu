@@ -0,0 +1,85 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <cuda.h>
+
+#include "graph.h"
+#include "graph_cache.h"
+#include "reorder.h"
+#include "vertex_state.h"
+#include "sssp_serial.h"
+#include "sssp_gpu.cuh"
+
+using namespace std;
+
+// Usage: gpu graph.gr [dev num] [-r bfs|rcm|degree]
+int main(int argc, const char** argv) {
+    VertexOrder order(take_reorder_option(argc, argv));
+
+    int gpucount = 0;
+    if (cudaGetDeviceCount(&gpucount) != cudaSuccess || gpucount == 0) {
+        printf("No GPUs are visible\n");
+        exit(1);
+    }
+    const int gpunum = argc > 2 ? atoi(argv[2]) : 0;
+    if (gpunum < 0 || gpunum >= gpucount) {
+        printf("\nDevice number must be between 0 and %d!\n", gpucount - 1);
+        exit(1);
+    }
+    gpu_check(cudaSetDevice(gpunum), "cudaSetDevice");
+
+    CSRGraph input, reordered;
+    double tLoad = omp_get_wtime();
+    if (argc <= 1 || !load_graph(argv[1], input)) {
+        printf("\nArgument number error or file does not exist!\n");
+        getchar();
+        exit(1);
+    }
+
+    tLoad = omp_get_wtime() - tLoad;
+    double tReorder = omp_get_wtime();
+    const CSRGraph& g = order.apply(input, reordered);
+    tReorder = omp_get_wtime() - tReorder;
+    const int nNodes = g.nNodes;
+    printf("nNodes = %d, nArcs = %ld, device = %d\n", g.nNodes, g.nArcs, gpunum);
+
+    double tUpload = omp_get_wtime();
+    GPUGraph dev_g(g);
+    GPUScratch scratch(nNodes);
+    tUpload = omp_get_wtime() - tUpload;
+
+    VertexArray<int> dist(nNodes + 1, INF);
+    int source = 1;
+    double tStart = omp_get_wtime(); // Start timing
+    moore_gpu(order.to_new(source), nNodes, dist, dev_g, scratch);
+    double tEnd = omp_get_wtime(); // End timing
+
+    // The device result has to match the serial engines exactly
+    VertexArray<int> check(nNodes + 1, INF);
+    SSSPScratch serial(nNodes);
+    dijkstra_radix(order.to_new(source), nNodes, check, g, serial);
+    int mismatch = 0;
+    for (int v = 1; v <= nNodes; ++ v) {
+        if (dist[v] != check[v]) mismatch ++;
+    }
+    order.to_original(dist, nNodes);
+
+    for (int i = 1; i < nNodes; i += 1000) {
+        printf("d(%d, %d) = %d\n", source, i, dist[i]);
+    }
+    printf("d(%d, %d) = %d\n", source, nNodes, dist[nNodes]);
+
+    printf("\nTook %.3lf s to load the graph.\n", tLoad);
+    if (order.enabled()) printf("Took %.3lf s to reorder the graph.\n", tReorder);
+    printf("Took %.3lf s to copy the graph to the device.\n", tUpload);
+    printf("Took %.3lf s to compute in %d rounds.\n", tEnd - tStart, scratch.round);
+    if (mismatch > 0) {
+        printf("%d distances differ from serial Dijkstra!\n", mismatch);
+        return 1;
+    }
+    printf("Distances match serial Dijkstra.\n");
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#ifndef PROJ_GRAPH_H
+#define PROJ_GRAPH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+// Compressed sparse row graph shared by all the SSSP solvers.
+// Vertices keep their DIMACS ids 1..nNodes; the neighbors of vertex v are
+// targets[offsets[v]] .. targets[offsets[v + 1] - 1], with the matching arc
+// lengths at the same positions of weights[]. Every DIMACS arc is stored in
+// both directions, so nEdges == 2 * nArcs.
+// The arrays are either malloc'ed by allocate() or point into a read-only
+// private file mapping handed over with adopt_mapping(); make_writable()
+// turns the mapping copy-on-write for callers that edit weights in place.
+class CSRGraph {
+public:
+    CSRGraph() : nNodes(0), nArcs(0), nEdges(0),
+                 offsets(NULL), targets(NULL), weights(NULL),
+                 map(NULL), mapSize(0) {}
+    ~CSRGraph() { release(); }
+
+    int nNodes;
+    long nArcs;
+    long nEdges;
+
+    long *offsets; // nNodes + 2 entries, offsets[0] == offsets[1] == 0
+    int *targets;  // nEdges entries
+    int *weights;  // nEdges entries
+
+    long degree(int v) const { return offsets[v + 1] - offsets[v]; }
+
+    // Sizes all arrays from the "p sp nNodes nArcs" header.
+    void allocate(int n, long m) {
+        release();
+        nNodes = n;
+        nArcs = m;
+        nEdges = 2 * m;
+        offsets = (long*) calloc(n + 2, sizeof(long));
+        targets = (int*) malloc(nEdges * sizeof(int));
+        weights = (int*) malloc(nEdges * sizeof(int));
+        if (offsets == NULL || targets == NULL || weights == NULL) {
+            printf("\nCannot allocate graph with %d nodes and %ld arcs!\n", n, m);
+            exit(1);
+        }
+    }
+
+    // Takes ownership of a mapping the arrays already point into.
+    void adopt_mapping(void *m, size_t size) {
+        map = m;
+        mapSize = size;
+    }
+
+    // Lets the arrays be modified. Written pages of a mapping become
+    // private copies, the snapshot file itself is never changed.
+    void make_writable() {
+        if (map != NULL && mprotect(map, mapSize, PROT_READ | PROT_WRITE) != 0) {
+            printf("\nCannot make the graph mapping writable!\n");
+            exit(1);
+        }
+    }
+
+    void release() {
+        if (map != NULL) {
+            munmap(map, mapSize);
+            map = NULL;
+            mapSize = 0;
+        } else {
+            free(offsets);
+            free(targets);
+            free(weights);
+        }
+        offsets = NULL;
+        targets = NULL;
+        weights = NULL;
+    }
+
+private:
+    void *map;
+    size_t mapSize;
+
+    CSRGraph(const CSRGraph&);
+    CSRGraph& operator=(const CSRGraph&);
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef PROJ_GRAPH_CACHE_H
+#define PROJ_GRAPH_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+
+#include "graph.h"
+#include "dimacs.h"
+
+// Binary snapshot of a CSRGraph. The file is the header below followed by
+// the offsets, targets and weights arrays, each starting on a
+// CACHE_ALIGN boundary, exactly as they sit in memory. Loading maps the file
+// read-only and points the graph straight into it: no parsing, no copying,
+// and the page cache is shared by every run on the same graph. The mapping
+// is private, so a run that edits weights after make_writable() only copies
+// the pages it touches.
+
+#define CACHE_MAGIC "CSRGRAPH"
+#define CACHE_VERSION 1
+#define CACHE_ALIGN 4096
+#define CACHE_SUFFIX ".csr"
+
+struct GraphCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t offsetSize; // sizeof(long) and sizeof(int) of the writer,
+    uint32_t indexSize;  // the arrays are only usable if they match ours
+    int32_t nNodes;
+    int64_t nArcs;
+    int64_t nEdges;
+    uint64_t offsetsPos;
+    uint64_t targetsPos;
+    uint64_t weightsPos;
+    uint64_t fileSize;
+};
+
+inline uint64_t cache_align(uint64_t pos) {
+    return (pos + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+inline void cache_layout(GraphCacheHeader& h, int nNodes, long nArcs, long nEdges) {
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.offsetSize = sizeof(long);
+    h.indexSize = sizeof(int);
+    h.nNodes = nNodes;
+    h.nArcs = nArcs;
+    h.nEdges = nEdges;
+    h.offsetsPos = cache_align(sizeof(GraphCacheHeader));
+    h.targetsPos = cache_align(h.offsetsPos + (uint64_t) (nNodes + 2) * sizeof(long));
+    h.weightsPos = cache_align(h.targetsPos + (uint64_t) nEdges * sizeof(int));
+    h.fileSize = h.weightsPos + (uint64_t) nEdges * sizeof(int);
+}
+
+inline bool cache_write_at(FILE *fp, uint64_t pos, const void *data, size_t bytes) {
+    return fseeko(fp, pos, SEEK_SET) == 0 && fwrite(data, 1, bytes, fp) == bytes;
+}
+
+// Writes g to path. The snapshot goes to a temporary file that is renamed
+// into place, so concurrent runs never map a half-written cache.
+inline bool save_graph_cache(const char *path, const CSRGraph& g) {
+    GraphCacheHeader h;
+    cache_layout(h, g.nNodes, g.nArcs, g.nEdges);
+
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long) getpid()) >= (int) sizeof(tmp)) {
+        return false;
+    }
+    FILE *fp = fopen(tmp, "wb");
+    if (fp == NULL) return false;
+    bool ok = cache_write_at(fp, 0, &h, sizeof(h))
+        && cache_write_at(fp, h.offsetsPos, g.offsets, (g.nNodes + 2) * sizeof(long))
+        && cache_write_at(fp, h.targetsPos, g.targets, g.nEdges * sizeof(int))
+        && cache_write_at(fp, h.weightsPos, g.weights, g.nEdges * sizeof(int));
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    return true;
+}
+
+// Reads the header of an open snapshot and checks that the file is one
+// written by save_graph_cache on a machine like ours.
+inline bool read_cache_header(int fd, GraphCacheHeader& h) {
+    GraphCacheHeader expect;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t) sizeof(h)) return false;
+    cache_layout(expect, h.nNodes, h.nArcs, h.nEdges);
+    return memcmp(&h, &expect, sizeof(h)) == 0 && (uint64_t) st.st_size >= h.fileSize;
+}
+
+// The snapshot to use for path: path itself if it is one, "<path>.csr" if
+// that is at least as new as path, NULL otherwise. cache holds PATH_MAX.
+inline const char* find_graph_cache(const char *path, char *cache) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    GraphCacheHeader h;
+    const bool isCache = read_cache_header(fd, h);
+    close(fd);
+    if (isCache) return path;
+
+    struct stat src, dst;
+    snprintf(cache, PATH_MAX, "%s%s", path, CACHE_SUFFIX);
+    if (stat(path, &src) < 0 || stat(cache, &dst) < 0 || dst.st_mtime < src.st_mtime) return NULL;
+    fd = open(cache, O_RDONLY);
+    if (fd < 0) return NULL;
+    const bool ok = read_cache_header(fd, h);
+    close(fd);
+    return ok ? cache : NULL;
+}
+
+// Maps a snapshot written by save_graph_cache into g. Returns false if the
+// file is missing or is not a usable snapshot.
+inline bool load_graph_cache(const char *path, CSRGraph& g) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    GraphCacheHeader h;
+    if (!read_cache_header(fd, h)) {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, h.fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    char *base = (char*) map;
+
+    g.release();
+    g.nNodes = h.nNodes;
+    g.nArcs = h.nArcs;
+    g.nEdges = h.nEdges;
+    g.offsets = (long*) (base + h.offsetsPos);
+    g.targets = (int*) (base + h.targetsPos);
+    g.weights = (int*) (base + h.weightsPos);
+    g.adopt_mapping(map, h.fileSize);
+    if (g.offsets[g.nNodes + 1] != g.nEdges) {
+        g.release();
+        return false;
+    }
+    return true;
+}
+
+// Loads the graph the solvers were pointed at. A snapshot file is mapped
+// directly. For a DIMACS file, a fresh "<path>.csr" snapshot next to it is
+// used if there is one; otherwise the file is parsed and the snapshot is
+// written for the next run.
+inline bool load_graph(const char *path, CSRGraph& g) {
+    if (load_graph_cache(path, g)) return true;
+
+    struct stat src;
+    if (stat(path, &src) < 0) return false;
+    char cache[PATH_MAX];
+    snprintf(cache, sizeof(cache), "%s%s", path, CACHE_SUFFIX);
+    struct stat dst;
+    if (stat(cache, &dst) == 0 && dst.st_mtime >= src.st_mtime
+        && load_graph_cache(cache, g)) {
+        return true;
+    }
+
+    if (!load_dimacs(path, g)) return false;
+    if (save_graph_cache(cache, g)) {
+        printf("Wrote graph cache %s\n", cache);
+    } else {
+        printf("Cannot write graph cache %s, continuing without it\n", cache);
+    }
+    return true;
+}
+
+#endif
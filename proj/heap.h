@@ -0,0 +1,133 @@
+#ifndef PROJ_HEAP_H
+#define PROJ_HEAP_H
+
+#include <vector>
+#include <utility>
+
+// Binary min-heap of vertex ids ordered by an external key array (the
+// solver's dist[]). pos[] tracks where each vertex sits so a lowered key can
+// be sifted up in place instead of pushing a duplicate.
+class IndexedHeap {
+public:
+    IndexedHeap(int nNodes, const int key[]) : key(key), pos(nNodes + 1, -1) {
+        heap.reserve(nNodes);
+    }
+
+    bool empty() const { return heap.empty(); }
+    bool contains(int v) const { return pos[v] >= 0; }
+
+    // Rebinds an empty heap to a new key array for the next query.
+    void reset(const int newKey[]) { key = newKey; }
+
+    // Inserts v, or moves it up after key[v] was lowered.
+    void push_or_decrease(int v) {
+        if (pos[v] < 0) {
+            pos[v] = heap.size();
+            heap.push_back(v);
+        }
+        sift_up(pos[v]);
+    }
+
+    int pop() {
+        const int top = heap[0];
+        const int last = heap.back();
+        heap.pop_back();
+        pos[top] = -1;
+        if (!heap.empty()) {
+            heap[0] = last;
+            pos[last] = 0;
+            sift_down(0);
+        }
+        return top;
+    }
+
+private:
+    const int *key;
+    std::vector<int> heap;
+    std::vector<int> pos;
+
+    void place(int i, int v) {
+        heap[i] = v;
+        pos[v] = i;
+    }
+
+    void sift_up(int i) {
+        const int v = heap[i];
+        while (i > 0) {
+            const int parent = (i - 1) / 2;
+            if (key[heap[parent]] <= key[v]) break;
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, v);
+    }
+
+    void sift_down(int i) {
+        const int v = heap[i], n = heap.size();
+        while (true) {
+            int child = 2 * i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && key[heap[child + 1]] < key[heap[child]]) child ++;
+            if (key[heap[child]] >= key[v]) break;
+            place(i, heap[child]);
+            i = child;
+        }
+        place(i, v);
+    }
+};
+
+// Monotone radix heap for non-negative integer keys: every pushed key must be
+// at least the last popped one, which always holds for Dijkstra with
+// non-negative weights. Bucket b > 0 holds keys whose highest bit differing
+// from the last popped key is bit b - 1, so each entry moves down at most 32
+// times. There is no decrease-key; the caller pushes again and skips stale
+// entries on pop.
+class RadixHeap {
+public:
+    RadixHeap() : last(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+
+    void reset() {
+        for (int b = 0; b < 33; ++ b) buckets[b].clear();
+        last = 0;
+        count = 0;
+    }
+
+    void push(unsigned key, int v) {
+        buckets[bucket_of(key)].push_back(std::make_pair(key, v));
+        count ++;
+    }
+
+    int pop(unsigned *key) {
+        if (buckets[0].empty()) {
+            int b = 1;
+            while (buckets[b].empty()) b ++;
+            std::vector<std::pair<unsigned, int> >& from = buckets[b];
+            last = from[0].first;
+            for (size_t i = 1; i < from.size(); ++ i) {
+                if (from[i].first < last) last = from[i].first;
+            }
+            for (size_t i = 0; i < from.size(); ++ i) {
+                buckets[bucket_of(from[i].first)].push_back(from[i]);
+            }
+            from.clear();
+        }
+        const std::pair<unsigned, int> top = buckets[0].back();
+        buckets[0].pop_back();
+        count --;
+        *key = top.first;
+        return top.second;
+    }
+
+private:
+    std::vector<std::pair<unsigned, int> > buckets[33];
+    unsigned last;
+    size_t count;
+
+    int bucket_of(unsigned key) const {
+        return key == last ? 0 : 32 - __builtin_clz(key ^ last);
+    }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef PROJ_REORDER_H
+#define PROJ_REORDER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "dimacs.h"
+
+// Optional relabeling pass run before the solvers. DIMACS ids follow
+// whatever order the data was exported in, so the dist[vj] reads of a
+// relaxation scatter across the whole array; renumbering vertices so that
+// neighbors get nearby ids turns most of them into cache hits.
+//
+//   bfs    - breadth-first order, one component after another
+//   rcm    - reverse Cuthill-McKee: BFS from a low-degree vertex visiting
+//            neighbors by increasing degree, then reversed (bandwidth
+//            reduction)
+//   degree - decreasing degree, so the hubs share cache lines
+//
+// The solvers run on the relabeled copy; to_new() maps a query vertex in and
+// to_original() puts a dist array back into DIMACS ids for output.
+
+enum ReorderKind { REORDER_NONE, REORDER_BFS, REORDER_RCM, REORDER_DEGREE };
+
+// Strips a "-r <bfs|rcm|degree>" pair from the command line so the mains
+// keep their positional arguments.
+inline ReorderKind take_reorder_option(int& argc, const char** argv) {
+    for (int i = 1; i < argc; ++ i) {
+        if (strcmp(argv[i], "-r") != 0) continue;
+        if (i + 1 >= argc) {
+            printf("\nOption -r expects bfs, rcm or degree!\n");
+            exit(1);
+        }
+        ReorderKind kind;
+        if (strcmp(argv[i + 1], "bfs") == 0) kind = REORDER_BFS;
+        else if (strcmp(argv[i + 1], "rcm") == 0) kind = REORDER_RCM;
+        else if (strcmp(argv[i + 1], "degree") == 0) kind = REORDER_DEGREE;
+        else {
+            printf("\nUnknown order %s, expected bfs, rcm or degree!\n", argv[i + 1]);
+            exit(1);
+        }
+        for (int j = i; j + 2 < argc; ++ j) argv[j] = argv[j + 2];
+        argc -= 2;
+        return kind;
+    }
+    return REORDER_NONE;
+}
+
+class VertexOrder {
+public:
+    VertexOrder(ReorderKind kind) : kind(kind) {}
+
+    bool enabled() const { return kind != REORDER_NONE; }
+    int to_new(int v) const { return enabled() ? perm[v] : v; }
+
+    // Builds the relabeled copy of g in out and returns it, or returns g
+    // itself when no reordering was asked for.
+    const CSRGraph& apply(const CSRGraph& g, CSRGraph& out) {
+        if (!enabled()) return g;
+        const int n = g.nNodes;
+        order.clear();
+        order.reserve(n);
+        if (kind == REORDER_DEGREE) {
+            degree_order(g);
+        } else {
+            bfs_order(g, kind == REORDER_RCM);
+        }
+
+        // order[k] is the old id of new vertex k + 1
+        perm.assign(n + 1, 0);
+        for (int k = 0; k < n; ++ k) perm[order[k]] = k + 1;
+
+        out.allocate(n, g.nArcs);
+        for (int k = 1; k <= n; ++ k) {
+            out.offsets[k + 1] = out.offsets[k] + g.degree(order[k - 1]);
+        }
+        #pragma omp parallel for schedule(dynamic, 1024)
+        for (int k = 1; k <= n; ++ k) {
+            const int v = order[k - 1];
+            long pos = out.offsets[k];
+            for (long j = g.offsets[v]; j < g.offsets[v + 1]; ++ j, ++ pos) {
+                out.targets[pos] = perm[g.targets[j]];
+                out.weights[pos] = g.weights[j];
+            }
+            dimacs_sort_neighbors(out, k);
+        }
+        return out;
+    }
+
+    // Rewrites dist[1..nNodes] from new ids back to the original ones.
+    void to_original(int dist[], int nNodes) const {
+        if (!enabled()) return;
+        std::vector<int> tmp(dist + 1, dist + nNodes + 1);
+        #pragma omp parallel for
+        for (int v = 1; v <= nNodes; ++ v) {
+            dist[v] = tmp[perm[v] - 1];
+        }
+    }
+
+private:
+    ReorderKind kind;
+    std::vector<int> order; // new position -> old id
+    std::vector<int> perm;  // old id -> new id
+
+    void degree_order(const CSRGraph& g) {
+        std::vector<std::pair<long, int> > keyed(g.nNodes);
+        for (int v = 1; v <= g.nNodes; ++ v) keyed[v - 1] = std::make_pair(-g.degree(v), v);
+        std::sort(keyed.begin(), keyed.end());
+        for (int k = 0; k < g.nNodes; ++ k) order.push_back(keyed[k].second);
+    }
+
+    // BFS over every component in turn. For RCM each component starts from
+    // its lowest-degree vertex, neighbors are queued by increasing degree,
+    // and the final order is reversed.
+    void bfs_order(const CSRGraph& g, bool rcm) {
+        const int n = g.nNodes;
+        std::vector<char> seen(n + 1, 0);
+        std::vector<int> starts;
+        if (rcm) {
+            std::vector<std::pair<long, int> > keyed(n);
+            for (int v = 1; v <= n; ++ v) keyed[v - 1] = std::make_pair(g.degree(v), v);
+            std::sort(keyed.begin(), keyed.end());
+            for (int k = 0; k < n; ++ k) starts.push_back(keyed[k].second);
+        } else {
+            for (int v = 1; v <= n; ++ v) starts.push_back(v);
+        }
+
+        std::vector<std::pair<long, int> > next;
+        for (int s = 0; s < n; ++ s) {
+            const int root = starts[s];
+            if (seen[root]) continue;
+            seen[root] = 1;
+            size_t head = order.size();
+            order.push_back(root);
+            while (head < order.size()) {
+                const int u = order[head ++];
+                next.clear();
+                for (long j = g.offsets[u]; j < g.offsets[u + 1]; ++ j) {
+                    const int v = g.targets[j];
+                    if (seen[v]) continue;
+                    seen[v] = 1;
+                    next.push_back(std::make_pair(rcm ? g.degree(v) : 0, v));
+                }
+                if (rcm) std::sort(next.begin(), next.end());
+                for (size_t k = 0; k < next.size(); ++ k) order.push_back(next[k].second);
+            }
+        }
+        if (rcm) std::reverse(order.begin(), order.end());
+    }
+};
+
+#endif
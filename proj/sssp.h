@@ -0,0 +1,20 @@
+#ifndef PROJ_SSSP_H
+#define PROJ_SSSP_H
+
+#include <limits.h>
+
+// Distance of a vertex the source cannot reach, shared by every engine so
+// their dist arrays can be compared directly.
+#define INF INT_MAX
+
+// Arcs scanned by the engines since the counter was last cleared. Engines
+// add their total once per call (or once per thread), never per arc; the
+// benchmark divides it by the solve time to report MTEPS.
+static long sssp_arcs_scanned = 0;
+
+inline void count_arcs(long n) {
+    #pragma omp atomic
+    sssp_arcs_scanned += n;
+}
+
+#endif
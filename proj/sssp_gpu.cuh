@@ -0,0 +1,179 @@
+#ifndef PROJ_SSSP_GPU_CUH
+#define PROJ_SSSP_GPU_CUH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cuda.h>
+#include <algorithm>
+
+#include "graph.h"
+#include "sssp.h"
+
+// Moore (frontier Bellman-Ford) on the GPU. Each round one thread takes one
+// vertex of the current frontier and relaxes its arcs with atomicMin; a
+// target whose distance dropped is claimed for the next frontier through a
+// per-vertex round stamp, so it is queued at most once per round. Claimed
+// vertices are appended warp by warp: a ballot collects the lanes that
+// claimed one, lane 0 reserves room for all of them with a single
+// atomicAdd, and each lane writes at its popcount offset. The next
+// frontier is therefore dense and needs no separate compaction pass.
+//
+// Needs CUDA 9 or later for the *_sync warp intrinsics.
+
+#define GPU_BLOCK 256
+#define FULL_MASK 0xffffffffu
+
+inline void gpu_check(cudaError_t err, const char *what) {
+    if (err != cudaSuccess) {
+        printf("\nCUDA error in %s: %s\n", what, cudaGetErrorString(err));
+        exit(1);
+    }
+}
+
+inline int gpu_blocks(long n) {
+    return (int) ((n + GPU_BLOCK - 1) / GPU_BLOCK);
+}
+
+// Device copy of a CSRGraph, uploaded once and shared by every query.
+class GPUGraph {
+public:
+    GPUGraph(const CSRGraph& g) : nNodes(g.nNodes), nEdges(g.nEdges) {
+        gpu_check(cudaMalloc((void **) &offsets, (nNodes + 2) * sizeof(long)), "cudaMalloc offsets");
+        gpu_check(cudaMalloc((void **) &targets, (nEdges + 1) * sizeof(int)), "cudaMalloc targets");
+        gpu_check(cudaMalloc((void **) &weights, (nEdges + 1) * sizeof(int)), "cudaMalloc weights");
+        gpu_check(cudaMemcpy(offsets, g.offsets, (nNodes + 2) * sizeof(long), cudaMemcpyHostToDevice), "upload offsets");
+        gpu_check(cudaMemcpy(targets, g.targets, nEdges * sizeof(int), cudaMemcpyHostToDevice), "upload targets");
+        gpu_check(cudaMemcpy(weights, g.weights, nEdges * sizeof(int), cudaMemcpyHostToDevice), "upload weights");
+    }
+    ~GPUGraph() {
+        cudaFree(offsets);
+        cudaFree(targets);
+        cudaFree(weights);
+    }
+
+    int nNodes;
+    long nEdges;   // both directions of every arc, as in CSRGraph
+    long *offsets;
+    int *targets;
+    int *weights;
+
+private:
+    GPUGraph(const GPUGraph&);
+    GPUGraph& operator=(const GPUGraph&);
+};
+
+// Device working memory of moore_gpu, reused from query to query. The round
+// counter keeps growing across queries so the stamps never need clearing.
+class GPUScratch {
+public:
+    GPUScratch(int nNodes) : round(0) {
+        gpu_check(cudaMalloc((void **) &dist, (nNodes + 1) * sizeof(int)), "cudaMalloc dist");
+        gpu_check(cudaMalloc((void **) &stamp, (nNodes + 1) * sizeof(int)), "cudaMalloc stamp");
+        gpu_check(cudaMalloc((void **) &front, (nNodes + 1) * sizeof(int)), "cudaMalloc front");
+        gpu_check(cudaMalloc((void **) &next, (nNodes + 1) * sizeof(int)), "cudaMalloc next");
+        gpu_check(cudaMalloc((void **) &nextSize, sizeof(int)), "cudaMalloc nextSize");
+        gpu_check(cudaMalloc((void **) &scanned, sizeof(unsigned long long)), "cudaMalloc scanned");
+        gpu_check(cudaMemset(stamp, 0, (nNodes + 1) * sizeof(int)), "clear stamp");
+    }
+    ~GPUScratch() {
+        cudaFree(dist);
+        cudaFree(stamp);
+        cudaFree(front);
+        cudaFree(next);
+        cudaFree(nextSize);
+        cudaFree(scanned);
+    }
+
+    int *dist;
+    int *stamp;    // round in which a vertex was last queued
+    int *front;    // current frontier
+    int *next;     // frontier being built
+    int *nextSize;
+    unsigned long long *scanned;
+    int round;
+
+private:
+    GPUScratch(const GPUScratch&);
+    GPUScratch& operator=(const GPUScratch&);
+};
+
+__global__ void gpu_sssp_init(int source, int nNodes, int *dist, int *front) {
+    const int v = blockIdx.x * blockDim.x + threadIdx.x;
+    if (v <= nNodes) dist[v] = (v == source) ? 0 : INF;
+    if (v == 0) front[0] = source;
+}
+
+// One round of relaxations. The grid is a whole number of full warps, and
+// lanes past the end of the frontier take part with degree 0, so every
+// ballot and shuffle below is issued by all 32 lanes.
+__global__ void gpu_sssp_relax(const long *offsets, const int *targets, const int *weights,
+                               int *dist, int *stamp, int round,
+                               const int *front, int frontSize, int *next, int *nextSize,
+                               unsigned long long *scanned) {
+    const int k = blockIdx.x * blockDim.x + threadIdx.x;
+    const int lane = threadIdx.x % warpSize;
+    const unsigned below = (1u << lane) - 1; // lanes lower than this one
+
+    int di = 0, deg = 0;
+    long first = 0;
+    if (k < frontSize) {
+        const int vi = front[k];
+        first = offsets[vi];
+        deg = (int) (offsets[vi + 1] - first);
+        di = dist[vi];
+    }
+
+    // The warp walks its largest degree together; also sum the degrees for
+    // the arcs-scanned counter
+    int steps = deg, sum = deg;
+    for (int o = warpSize / 2; o > 0; o /= 2) {
+        steps = max(steps, __shfl_xor_sync(FULL_MASK, steps, o));
+        sum += __shfl_xor_sync(FULL_MASK, sum, o);
+    }
+    if (lane == 0 && sum > 0) atomicAdd(scanned, (unsigned long long) sum);
+
+    for (int j = 0; j < steps; ++ j) {
+        bool claim = false;
+        int vj = 0;
+        if (j < deg) {
+            vj = targets[first + j];
+            const int new_dist = di + weights[first + j];
+            if (atomicMin(&dist[vj], new_dist) > new_dist && offsets[vj + 1] > offsets[vj]) {
+                claim = atomicExch(&stamp[vj], round) != round;
+            }
+        }
+        const unsigned ballot = __ballot_sync(FULL_MASK, claim);
+        if (ballot == 0) continue;
+        int base = 0;
+        if (lane == 0) base = atomicAdd(nextSize, __popc(ballot));
+        base = __shfl_sync(FULL_MASK, base, 0);
+        if (claim) next[base + __popc(ballot & below)] = vj;
+    }
+}
+
+// Same contract as moore(): fills dist[1..nNodes] on the host, INF for
+// vertices the source cannot reach. The graph and scratch stay on the device
+// between calls, so a batch of sources pays for the upload only once.
+inline void moore_gpu(int source, int nNodes, int dist[], const GPUGraph& g, GPUScratch& s) {
+    gpu_sssp_init <<< gpu_blocks(nNodes + 1), GPU_BLOCK >>> (source, nNodes, s.dist, s.front);
+    gpu_check(cudaGetLastError(), "gpu_sssp_init");
+    gpu_check(cudaMemset(s.scanned, 0, sizeof(unsigned long long)), "clear scanned");
+
+    int frontSize = 1;
+    while (frontSize > 0) {
+        s.round ++;
+        gpu_check(cudaMemset(s.nextSize, 0, sizeof(int)), "clear nextSize");
+        gpu_sssp_relax <<< gpu_blocks(frontSize), GPU_BLOCK >>> (g.offsets, g.targets, g.weights,
+                       s.dist, s.stamp, s.round, s.front, frontSize, s.next, s.nextSize, s.scanned);
+        gpu_check(cudaGetLastError(), "gpu_sssp_relax");
+        gpu_check(cudaMemcpy(&frontSize, s.nextSize, sizeof(int), cudaMemcpyDeviceToHost), "read nextSize");
+        std::swap(s.front, s.next);
+    }
+
+    unsigned long long scanned = 0;
+    gpu_check(cudaMemcpy(dist, s.dist, (nNodes + 1) * sizeof(int), cudaMemcpyDeviceToHost), "download dist");
+    gpu_check(cudaMemcpy(&scanned, s.scanned, sizeof(scanned), cudaMemcpyDeviceToHost), "read scanned");
+    count_arcs((long) scanned);
+}
+
+#endif
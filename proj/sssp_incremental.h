@@ -0,0 +1,174 @@
+#ifndef PROJ_SSSP_INCREMENTAL_H
+#define PROJ_SSSP_INCREMENTAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "graph.h"
+#include "sssp.h"
+#include "sssp_serial.h"
+#include "vertex_state.h"
+
+using namespace std;
+
+// Repairs a finished dist[] when some arc lengths change, instead of
+// solving again from dist[i] = INF. The solvers treat every arc as
+// undirected, so an update (u, v, w) sets every stored u-v arc to w in both
+// directions.
+//
+// Increases: a vertex can only get worse if an arc it was tight on
+// (dist[x] + old == dist[v]) got longer. Those vertices are examined in
+// increasing dist order; one that still has a tight arc of positive length
+// from a vertex that kept its label keeps its own, otherwise it is
+// invalidated and its tight children are examined next. This is the
+// shortest-path subtree hanging off the changed arcs, without having to
+// store parent pointers. Zero-length support is ignored, which can only
+// invalidate more than needed.
+//
+// Invalidated vertices are then seeded from their valid neighbors, the
+// targets of shortened arcs are relaxed, and moore_propagate() settles
+// everything from that queue. The work is proportional to the region whose
+// distances actually change.
+
+struct WeightUpdate {
+    int src;
+    int dst;
+    int weight;
+};
+
+// Working memory of repair_sssp, reused across batches. affected is left
+// clear between calls.
+class RepairScratch {
+public:
+    RepairScratch(int nNodes) : affected(nNodes + 1) {}
+
+    class ChangedArc {
+    public:
+        long pos;
+        int from;
+        int orig; // length before this batch
+        bool operator<(const ChangedArc& o) const { return pos < o.pos; }
+    };
+
+    VertexBitset affected;
+    vector<int> invalid;
+    vector<ChangedArc> changed;
+};
+
+// Sets every u -> v arc to w, recording the original length of each.
+inline void set_arc_weight(CSRGraph& g, int u, int v, int w, RepairScratch& r) {
+    const int *lo = g.targets + g.offsets[u], *hi = g.targets + g.offsets[u + 1];
+    const int *first = lower_bound(lo, hi, v);
+    for (const int *t = first; t < hi && *t == v; ++ t) {
+        RepairScratch::ChangedArc c;
+        c.pos = t - g.targets;
+        c.from = u;
+        c.orig = g.weights[c.pos];
+        r.changed.push_back(c);
+        g.weights[c.pos] = w;
+    }
+}
+
+// Applies updates to g's arc lengths and brings dist[] (the result of a
+// solve from source on the old lengths) up to date. g must be writable.
+// Returns the number of vertices that had to be invalidated.
+inline long repair_sssp(int source, int nNodes, int dist[], CSRGraph& g,
+                        const vector<WeightUpdate>& updates,
+                        SSSPScratch& s, RepairScratch& r) {
+    r.changed.clear();
+    for (size_t k = 0; k < updates.size(); ++ k) {
+        const WeightUpdate& u = updates[k];
+        if (u.src < 1 || u.src > nNodes || u.dst < 1 || u.dst > nNodes || u.weight < 0) {
+            printf("\nInvalid update %d %d %d!\n", u.src, u.dst, u.weight);
+            exit(1);
+        }
+        const size_t before = r.changed.size();
+        set_arc_weight(g, u.src, u.dst, u.weight, r);
+        set_arc_weight(g, u.dst, u.src, u.weight, r);
+        if (r.changed.size() == before) {
+            printf("\nArc %d-%d does not exist!\n", u.src, u.dst);
+            exit(1);
+        }
+    }
+    // An arc changed twice in one batch must be judged on its first length
+    stable_sort(r.changed.begin(), r.changed.end());
+
+    IndexedHeap& candidates = s.heap;
+    VertexBitset& affected = r.affected;
+    candidates.reset(dist);
+    for (size_t k = 0; k < r.changed.size(); ++ k) {
+        const RepairScratch::ChangedArc& c = r.changed[k];
+        if (k > 0 && r.changed[k - 1].pos == c.pos) continue;
+        const int v = g.targets[c.pos];
+        if (g.weights[c.pos] > c.orig && dist[c.from] != INF && v != source
+            && dist[c.from] + c.orig == dist[v]) {
+            candidates.push_or_decrease(v);
+        }
+    }
+
+    r.invalid.clear();
+    while (!candidates.empty()) {
+        const int v = candidates.pop();
+        bool supported = false;
+        for (long j = g.offsets[v]; j < g.offsets[v + 1] && !supported; ++ j) {
+            const int x = g.targets[j];
+            const int w = g.weights[j];
+            supported = w > 0 && dist[x] != INF && !affected.test(x) && dist[x] + w == dist[v];
+        }
+        if (supported) continue;
+
+        // Children are the vertices tight on v under the old lengths. An arc
+        // shortened in this batch now gives less than dist[y], so <= keeps
+        // them; examining a vertex that did not depend on v is harmless.
+        affected.set(v);
+        r.invalid.push_back(v);
+        for (long j = g.offsets[v]; j < g.offsets[v + 1]; ++ j) {
+            const int y = g.targets[j];
+            if (y != source && !affected.test(y) && !candidates.contains(y)
+                && dist[y] != INF && dist[v] + g.weights[j] <= dist[y]) {
+                candidates.push_or_decrease(y);
+            }
+        }
+    }
+
+    s.flags.clear_all();
+    for (size_t k = 0; k < r.invalid.size(); ++ k) {
+        dist[r.invalid[k]] = INF;
+    }
+    for (size_t k = 0; k < r.invalid.size(); ++ k) {
+        const int v = r.invalid[k];
+        for (long j = g.offsets[v]; j < g.offsets[v + 1]; ++ j) {
+            const int x = g.targets[j];
+            if (!affected.test(x) && dist[x] != INF && dist[x] + g.weights[j] < dist[v]) {
+                dist[v] = dist[x] + g.weights[j];
+            }
+        }
+        if (dist[v] != INF) {
+            s.fifo_q.push(v);
+            s.flags.set(v);
+        }
+    }
+    for (size_t k = 0; k < r.invalid.size(); ++ k) {
+        affected.clear(r.invalid[k]);
+    }
+
+    for (size_t k = 0; k < r.changed.size(); ++ k) {
+        const RepairScratch::ChangedArc& c = r.changed[k];
+        const int v = g.targets[c.pos];
+        const int new_dist = dist[c.from] + g.weights[c.pos];
+        if (dist[c.from] != INF && new_dist < dist[v]) {
+            dist[v] = new_dist;
+            if (!s.flags.test(v)) {
+                s.fifo_q.push(v);
+                s.flags.set(v);
+            }
+        }
+    }
+
+    moore_propagate(dist, g, s);
+    return r.invalid.size();
+}
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef PROJ_SSSP_MPI_H
+#define PROJ_SSSP_MPI_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <mpi.h>
+#include <algorithm>
+#include <vector>
+
+#include "graph.h"
+#include "dimacs.h"
+#include "graph_cache.h"
+#include "sssp.h"
+
+using namespace std;
+
+// Distributed-memory delta-stepping. Vertices are split into contiguous id
+// ranges, one per rank, and each rank keeps only the arcs leaving its own
+// range plus dist[] for its own vertices. Bins are settled in the same
+// order as delta_stepping(), every rank working on the same bin at once: a
+// relaxation of a local target is applied directly, one of a remote target
+// is appended to the buffer of the rank that owns it. A buffer is sent as
+// soon as it holds RELAX_BATCH relaxations, and incoming batches are applied
+// between local vertices, so messages travel while the local scan goes on.
+// At the end of a pass every rank sends a (possibly empty) closing batch to
+// every other one; once all closing batches are in, one Allreduce picks the
+// next bin.
+
+#define RELAX_BATCH 4096
+#define RELAX_POLL 64
+#define TAG_BATCH 1
+#define TAG_LAST 2
+
+// Contiguous vertex ranges: rank r owns first[r] .. first[r + 1] - 1.
+// Ranges are either equal in vertex count (block) or cut where the
+// prefix sum of degrees crosses a multiple of nEdges / nRanks (edges), so
+// that every rank scans about the same number of arcs.
+class Partition {
+public:
+    Partition(int nRanks) : first(nRanks + 1) {}
+    Partition(const CSRGraph& g, int nRanks, bool balanceEdges) : first(nRanks + 1) {
+        const int n = g.nNodes;
+        for (int r = 0; r <= nRanks; ++ r) {
+            if (balanceEdges) {
+                const long target = g.nEdges * r / nRanks;
+                first[r] = lower_bound(g.offsets + 1, g.offsets + n + 2, target) - g.offsets;
+            } else {
+                first[r] = 1 + (int) ((long) n * r / nRanks);
+            }
+        }
+        first[0] = 1;
+        first[nRanks] = n + 1;
+    }
+
+    // Equal vertex counts for nNodes vertices
+    void block(int nNodes) {
+        const int nRanks = first.size() - 1;
+        for (int r = 0; r <= nRanks; ++ r) {
+            first[r] = 1 + (int) ((long) nNodes * r / nRanks);
+        }
+    }
+
+    int owner(int v) const {
+        return upper_bound(first.begin(), first.end(), v) - first.begin() - 1;
+    }
+    int size(int r) const { return first[r + 1] - first[r]; }
+
+    vector<int> first;
+};
+
+// The arcs leaving one rank's range, in CSR form with global target ids.
+// Local vertex i is global vertex first + i.
+class LocalGraph {
+public:
+    LocalGraph() : nNodes(0), nArcs(0), first(1), nLocal(0), offsets(1, 0) {}
+    LocalGraph(const CSRGraph& g, const Partition& part, int rank)
+        : nNodes(g.nNodes), nArcs(g.nArcs),
+          first(part.first[rank]), nLocal(part.size(rank)), offsets(nLocal + 1) {
+        const long base = g.offsets[first];
+        for (int i = 0; i <= nLocal; ++ i) {
+            offsets[i] = g.offsets[first + i] - base;
+        }
+        targets.assign(g.targets + base, g.targets + base + offsets[nLocal]);
+        weights.assign(g.weights + base, g.weights + base + offsets[nLocal]);
+    }
+
+    long degree(int i) const { return offsets[i + 1] - offsets[i]; }
+
+    int nNodes; // of the whole graph
+    long nArcs;
+    int first;
+    int nLocal;
+    vector<long> offsets;
+    vector<int> targets;
+    vector<int> weights;
+};
+
+// Loading without the whole graph on any rank. A snapshot (see
+// graph_cache.h) is read slice by slice: each rank finds its own cut with a
+// binary search over the offsets in the file and reads just its range. A
+// DIMACS file is parsed in byte ranges, one per rank, and every arc is sent
+// to the rank that owns its source, first under block partitioning and,
+// for edges, once more after the cuts are known. Either way the arcs of a
+// vertex end up sorted as load_dimacs() leaves them, so the distributed
+// solver traverses them in the same order as the shared-memory ones.
+
+struct LocalArc {
+    int src, dst, w;
+
+    bool operator<(const LocalArc& o) const {
+        if (src != o.src) return src < o.src;
+        if (dst != o.dst) return dst < o.dst;
+        return w < o.w;
+    }
+};
+
+// Sends every arc to the owner of its source and leaves in arcs the ones
+// this rank received, sorted.
+inline void exchange_arcs(vector<LocalArc>& arcs, const Partition& part, MPI_Comm comm) {
+    const int nRanks = part.first.size() - 1;
+    vector<int> sendCounts(nRanks, 0), recvCounts(nRanks), sendDispls(nRanks + 1, 0), recvDispls(nRanks + 1, 0);
+    for (size_t k = 0; k < arcs.size(); ++ k) sendCounts[part.owner(arcs[k].src)] ++;
+    for (int r = 0; r < nRanks; ++ r) sendDispls[r + 1] = sendDispls[r] + sendCounts[r];
+
+    vector<LocalArc> send(arcs.size());
+    vector<int> cursor(sendDispls.begin(), sendDispls.end() - 1);
+    for (size_t k = 0; k < arcs.size(); ++ k) send[cursor[part.owner(arcs[k].src)] ++] = arcs[k];
+    vector<LocalArc>().swap(arcs);
+
+    MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &recvCounts[0], 1, MPI_INT, comm);
+    for (int r = 0; r < nRanks; ++ r) recvDispls[r + 1] = recvDispls[r] + recvCounts[r];
+    arcs.resize(recvDispls[nRanks]);
+
+    MPI_Datatype arc_t;
+    MPI_Type_contiguous(3, MPI_INT, &arc_t);
+    MPI_Type_commit(&arc_t);
+    MPI_Alltoallv(send.empty() ? NULL : &send[0], &sendCounts[0], &sendDispls[0], arc_t,
+                  arcs.empty() ? NULL : &arcs[0], &recvCounts[0], &recvDispls[0], arc_t, comm);
+    MPI_Type_free(&arc_t);
+    sort(arcs.begin(), arcs.end());
+}
+
+// Local CSR of rank's range from its arcs, sorted by source
+inline void build_local(const vector<LocalArc>& arcs, const Partition& part, int rank, LocalGraph& lg) {
+    lg.first = part.first[rank];
+    lg.nLocal = part.size(rank);
+    lg.offsets.assign(lg.nLocal + 1, 0);
+    for (size_t k = 0; k < arcs.size(); ++ k) lg.offsets[arcs[k].src - lg.first + 1] ++;
+    for (int i = 0; i < lg.nLocal; ++ i) lg.offsets[i + 1] += lg.offsets[i];
+    lg.targets.resize(arcs.size());
+    lg.weights.resize(arcs.size());
+    for (size_t k = 0; k < arcs.size(); ++ k) {
+        lg.targets[k] = arcs[k].dst;
+        lg.weights[k] = arcs[k].w;
+    }
+}
+
+inline bool read_local(int fd, uint64_t pos, void *data, size_t bytes) {
+    char *p = (char*) data;
+    while (bytes > 0) {
+        const ssize_t got = pread(fd, p, bytes, pos);
+        if (got <= 0) return false;
+        p += got;
+        pos += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+// Reads rank's slice of the snapshot at path. All ranks must get the same
+// answer from find_graph_cache() first.
+inline bool load_local_cache(const char *path, bool balanceEdges, Partition& part, LocalGraph& lg, MPI_Comm comm) {
+    int rank, nRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nRanks);
+
+    GraphCacheHeader h;
+    int fd = open(path, O_RDONLY);
+    int ok = fd >= 0 && read_cache_header(fd, h), all;
+    MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_LAND, comm);
+    if (!all) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    lg.nNodes = h.nNodes;
+    lg.nArcs = h.nArcs;
+
+    // First vertex v in 1..nNodes + 1 with offsets[v] >= nEdges * rank / nRanks,
+    // as in Partition(g, ...); the other cuts come from the other ranks
+    part.block(h.nNodes);
+    if (balanceEdges) {
+        const long target = h.nEdges * rank / nRanks;
+        int lo = 1, hi = h.nNodes + 1;
+        while (ok && lo < hi) {
+            const int mid = lo + (hi - lo) / 2;
+            long off;
+            ok = read_local(fd, h.offsetsPos + (uint64_t) mid * sizeof(long), &off, sizeof(long));
+            if (off >= target) hi = mid;
+            else lo = mid + 1;
+        }
+        MPI_Allgather(&lo, 1, MPI_INT, &part.first[0], 1, MPI_INT, comm);
+        part.first[0] = 1;
+        part.first[nRanks] = h.nNodes + 1;
+    }
+
+    lg.first = part.first[rank];
+    lg.nLocal = part.size(rank);
+    lg.offsets.resize(lg.nLocal + 1);
+    ok = ok && read_local(fd, h.offsetsPos + (uint64_t) lg.first * sizeof(long), &lg.offsets[0],
+                          (lg.nLocal + 1) * sizeof(long));
+    const long base = lg.offsets[0];
+    for (int i = 0; i <= lg.nLocal; ++ i) lg.offsets[i] -= base;
+    const long n = lg.offsets[lg.nLocal];
+    lg.targets.resize(n);
+    lg.weights.resize(n);
+    if (n > 0) {
+        ok = ok && read_local(fd, h.targetsPos + (uint64_t) base * sizeof(int), &lg.targets[0], n * sizeof(int))
+            && read_local(fd, h.weightsPos + (uint64_t) base * sizeof(int), &lg.weights[0], n * sizeof(int));
+    }
+    close(fd);
+    MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_LAND, comm);
+    return all;
+}
+
+// Parses rank's byte range of the DIMACS file at path and builds its slice
+inline bool load_local_dimacs(const char *path, bool balanceEdges, Partition& part, LocalGraph& lg, MPI_Comm comm) {
+    int rank, nRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nRanks);
+
+    int fd = open(path, O_RDONLY), ok = fd >= 0, all;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (ok) ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (ok) map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd >= 0) close(fd);
+    ok = ok && map != MAP_FAILED;
+    MPI_Allreduce(&ok, &all, 1, MPI_INT, MPI_LAND, comm);
+    if (!all) {
+        if (map != MAP_FAILED) munmap(map, st.st_size);
+        return false;
+    }
+
+    const char *end = (const char*) map + st.st_size;
+    long nNodes, nArcs, src, dst, w;
+    const char *body = dimacs_header((const char*) map, end, path, &nNodes, &nArcs);
+    lg.nNodes = (int) nNodes;
+    lg.nArcs = nArcs;
+
+    vector<LocalArc> arcs;
+    const char *p = dimacs_range_start(body, end, rank, nRanks);
+    const char *stop = dimacs_range_start(body, end, rank + 1, nRanks);
+    while ((p = dimacs_next_arc(p, stop, lg.nNodes, &src, &dst, &w)) != NULL) {
+        const LocalArc out = {(int) src, (int) dst, (int) w}, back = {(int) dst, (int) src, (int) w};
+        arcs.push_back(out);
+        arcs.push_back(back);
+    }
+    munmap(map, st.st_size);
+
+    long mine = arcs.size() / 2, nParsed;
+    MPI_Allreduce(&mine, &nParsed, 1, MPI_LONG, MPI_SUM, comm);
+    if (nParsed != nArcs) {
+        if (rank == 0) printf("\nHeader announces %ld arcs but %s has %ld!\n", nArcs, path, nParsed);
+        MPI_Abort(comm, 1);
+    }
+
+    part.block(lg.nNodes);
+    exchange_arcs(arcs, part, comm);
+    if (balanceEdges) {
+        // Global offsets of the own block give the cuts that fall in it;
+        // every other cut is left at nNodes + 1 for the MIN to override
+        const int first = part.first[rank], n = part.size(rank);
+        vector<long> offsets(n + 1, 0);
+        for (size_t k = 0; k < arcs.size(); ++ k) offsets[arcs[k].src - first + 1] ++;
+        long before = 0, count = arcs.size();
+        MPI_Exscan(&count, &before, 1, MPI_LONG, MPI_SUM, comm);
+        if (rank == 0) before = 0;  // undefined there
+        offsets[0] = before;
+        for (int i = 0; i < n; ++ i) offsets[i + 1] += offsets[i];
+
+        vector<int> cuts(nRanks + 1, lg.nNodes + 1);
+        for (int r = 0; r <= nRanks; ++ r) {
+            const long target = 2 * nArcs * r / nRanks;
+            const long i = lower_bound(offsets.begin(), offsets.begin() + n, target) - offsets.begin();
+            if (i < n) cuts[r] = first + i;
+        }
+        MPI_Allreduce(&cuts[0], &part.first[0], nRanks + 1, MPI_INT, MPI_MIN, comm);
+        part.first[0] = 1;
+        part.first[nRanks] = lg.nNodes + 1;
+        exchange_arcs(arcs, part, comm);
+    }
+    build_local(arcs, part, rank, lg);
+    return true;
+}
+
+// Loads rank's slice of the graph at path, from its snapshot if there is
+// a fresh one and from the DIMACS file otherwise.
+inline bool load_local_graph(const char *path, bool balanceEdges, Partition& part, LocalGraph& lg, MPI_Comm comm) {
+    char cache[PATH_MAX];
+    const char *snapshot = find_graph_cache(path, cache);
+    int mine = snapshot != NULL, all;
+    MPI_Allreduce(&mine, &all, 1, MPI_INT, MPI_LAND, comm);
+    if (all) return load_local_cache(snapshot, balanceEdges, part, lg, comm);
+    return load_local_dimacs(path, balanceEdges, part, lg, comm);
+}
+
+// default_delta() over the slices: the mean arc length of the whole graph
+inline int default_delta_mpi(const LocalGraph& lg, MPI_Comm comm) {
+    double local[2] = {0, (double) lg.weights.size()}, total[2];
+    for (size_t j = 0; j < lg.weights.size(); ++ j) local[0] += lg.weights[j];
+    MPI_Allreduce(local, total, 2, MPI_DOUBLE, MPI_SUM, comm);
+    const int delta = total[1] > 0 ? (int) (total[0] / total[1]) : 1;
+    return delta > 0 ? delta : 1;
+}
+
+// Outgoing relaxations, kept as (vertex, distance) pairs per destination.
+// Full buffers are handed to MPI_Isend and parked until the pass ends.
+class RelaxExchange {
+public:
+    RelaxExchange(int rank, int nRanks, MPI_Comm comm)
+        : rank(rank), nRanks(nRanks), closed(0), comm(comm), out(nRanks) {}
+
+    void push(int dest, int v, int d) {
+        out[dest].push_back(v);
+        out[dest].push_back(d);
+        if (out[dest].size() >= 2 * RELAX_BATCH) send(dest, TAG_BATCH);
+    }
+
+    // Hands every batch that has arrived to apply(v, d) without blocking.
+    template <typename Apply>
+    void poll(Apply& apply) {
+        int flag;
+        MPI_Status status;
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &flag, &status);
+        while (flag) {
+            receive(status, apply);
+            MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &flag, &status);
+        }
+    }
+
+    // Closes the pass: flushes all buffers, then applies incoming batches
+    // until every other rank's closing batch has been seen.
+    template <typename Apply>
+    void finish(Apply& apply) {
+        for (int dest = 0; dest < nRanks; ++ dest) {
+            if (dest != rank) send(dest, TAG_LAST);
+        }
+        while (closed < nRanks - 1) {
+            MPI_Status status;
+            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
+            receive(status, apply);
+        }
+        closed = 0;
+        if (!requests.empty()) MPI_Waitall(requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+        requests.clear();
+        inFlight.clear();
+    }
+
+private:
+    int rank, nRanks, closed;
+    MPI_Comm comm;
+    vector<vector<int> > out;
+    vector<vector<int> > inFlight;
+    vector<MPI_Request> requests;
+    vector<int> in;
+
+    void send(int dest, int tag) {
+        inFlight.push_back(vector<int>());
+        inFlight.back().swap(out[dest]);
+        vector<int>& buf = inFlight.back();
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(buf.empty() ? NULL : &buf[0], buf.size(), MPI_INT, dest, tag, comm, &requests.back());
+    }
+
+    template <typename Apply>
+    void receive(MPI_Status& status, Apply& apply) {
+        int count;
+        MPI_Get_count(&status, MPI_INT, &count);
+        in.resize(count);
+        MPI_Recv(count == 0 ? NULL : &in[0], count, MPI_INT, status.MPI_SOURCE, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
+        for (int k = 0; k < count; k += 2) apply(in[k], in[k + 1]);
+        if (status.MPI_TAG == TAG_LAST) closed ++;
+    }
+};
+
+// Lowers dist of an owned vertex and files it under its new bin.
+class LocalBins {
+public:
+    LocalBins(const LocalGraph& lg, int dist[], int delta) : lg(lg), dist(dist), delta(delta) {}
+
+    void operator()(int v, int d) {
+        const int i = v - lg.first;
+        if (d >= dist[i]) return;
+        dist[i] = d;
+        const size_t bin = d / delta;
+        if (bin >= bins.size()) bins.resize(bin + 1);
+        bins[bin].push_back(i);
+    }
+
+    // Lowest non-empty bin from b on, or LONG_MAX.
+    long next_bin(size_t b) const {
+        for (; b < bins.size(); ++ b) {
+            if (!bins[b].empty()) return b;
+        }
+        return LONG_MAX;
+    }
+
+    const LocalGraph& lg;
+    int *dist;
+    int delta;
+    vector<vector<int> > bins;
+};
+
+// dist[i] receives the distance of global vertex lg.first + i. Returns the
+// number of arcs this rank scanned.
+inline long delta_stepping_mpi(int source, const LocalGraph& lg, const Partition& part,
+                               int dist[], int delta, MPI_Comm comm) {
+    int rank, nRanks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nRanks);
+
+    for (int i = 0; i < lg.nLocal; ++ i) {
+        dist[i] = INF;
+    }
+    LocalBins local(lg, dist, delta);
+    RelaxExchange exchange(rank, nRanks, comm);
+    if (part.owner(source) == rank) local(source, 0);
+
+    vector<int> frontier;
+    long scanned = 0;
+    size_t currBin = 0;
+    while (true) {
+        // The current bin may have been refilled in the last pass, so the
+        // search starts at currBin rather than after it.
+        long mine = local.next_bin(currBin), next;
+        MPI_Allreduce(&mine, &next, 1, MPI_LONG, MPI_MIN, comm);
+        if (next == LONG_MAX) break;
+        currBin = next;
+
+        frontier.clear();
+        if (currBin < local.bins.size()) frontier.swap(local.bins[currBin]);
+        const long lower = (long) delta * currBin;
+        for (size_t k = 0; k < frontier.size(); ++ k) {
+            if (k % RELAX_POLL == 0) exchange.poll(local);
+            const int i = frontier[k];
+            const int di = dist[i];
+            if (di < lower) continue; // settled in an earlier bin already
+            scanned += lg.degree(i);
+
+            for (long j = lg.offsets[i]; j < lg.offsets[i + 1]; ++ j) {
+                const int vj = lg.targets[j];
+                const int new_dist = di + lg.weights[j];
+                const int dest = part.owner(vj);
+                if (dest == rank) {
+                    local(vj, new_dist);
+                } else {
+                    exchange.push(dest, vj, new_dist);
+                }
+            }
+        }
+        exchange.finish(local);
+    }
+    count_arcs(scanned);
+    return scanned;
+}
+
+#endif
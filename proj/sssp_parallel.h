@@ -0,0 +1,363 @@
+#ifndef PROJ_SSSP_PARALLEL_H
+#define PROJ_SSSP_PARALLEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include <vector>
+#include <queue>
+#include <deque>
+
+#include "graph.h"
+#include "sssp.h"
+#include "atomics.h"
+#include "vertex_state.h"
+
+// The OpenMP engines behind the parallel1/2/3 and deltastep targets, kept
+// together so the benchmark can run them side by side.
+
+#define CHUNK_SIZE 256
+#define NO_BIN ((size_t) -1)
+#define COUNT_STRIDE 8 // longs per cache line, for per-thread counters
+
+using namespace std;
+
+// Moore with the arcs of each dequeued vertex relaxed by an OpenMP loop.
+inline void moore_parallel1(int source, int nNodes, int dist[], const CSRGraph& g) {
+    VertexArray<bool> in_queue(nNodes + 1, false);
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+        in_queue[i] = false;
+    }
+    dist[source] = 0;
+
+    queue<int> fifo_q;
+    fifo_q.push(source);
+    in_queue[source] = true;
+
+    long scanned = 0;
+    while (fifo_q.size() > 0) {
+        const int vi = fifo_q.front();
+        in_queue[vi] = false;
+        fifo_q.pop();
+        scanned += g.degree(vi);
+
+        #pragma omp parallel for
+        for (long j = g.offsets[vi]; j < g.offsets[vi + 1]; ++ j) {
+            const int vj = g.targets[j];
+            const int new_dist = g.weights[j] + dist[vi];
+
+            if (atomic_min(&dist[vj], new_dist)) {
+                if (!in_queue[vj] && g.degree(vj) > 0) {
+                    in_queue[vj] = true;
+                    #pragma omp critical(q_update)
+                    fifo_q.push(vj);
+                }
+            }
+        }
+
+    } // end of parallel section
+    count_arcs(scanned);
+}
+
+// Fixed-size block of frontier vertices, the unit of work stealing.
+class Chunk {
+public:
+    Chunk() : size(0) {}
+    int size;
+    int v[CHUNK_SIZE];
+};
+
+// Per-thread deque of full chunks. The owner pops from the back, where its
+// most recent (cache-warm) chunks are; thieves take from the front. The lock
+// is only taken once per chunk, never per vertex.
+class ChunkDeque {
+public:
+    ChunkDeque() { omp_init_lock(&lock); }
+    ~ChunkDeque() { omp_destroy_lock(&lock); }
+
+    void push(Chunk *c) {
+        omp_set_lock(&lock);
+        chunks.push_back(c);
+        omp_unset_lock(&lock);
+    }
+
+    Chunk* pop() { return take(false); }
+    Chunk* steal() { return take(true); }
+
+private:
+    omp_lock_t lock;
+    deque<Chunk*> chunks;
+
+    ChunkDeque(const ChunkDeque&);
+    ChunkDeque& operator=(const ChunkDeque&);
+
+    Chunk* take(bool front) {
+        Chunk *c = NULL;
+        omp_set_lock(&lock);
+        if (!chunks.empty()) {
+            if (front) {
+                c = chunks.front();
+                chunks.pop_front();
+            } else {
+                c = chunks.back();
+                chunks.pop_back();
+            }
+        }
+        omp_unset_lock(&lock);
+        return c;
+    }
+};
+
+// Level-synchronous Moore: each round relaxes the whole frontier and builds
+// the next one. Every thread appends new vertices to a private chunk and
+// publishes it on its own deque of the next round once full; a thread that
+// runs out of chunks steals from the others. in_queue keeps a vertex from
+// entering the same frontier twice.
+inline void moore_parallel2(int source, int nNodes, int dist[], const CSRGraph& g) {
+    #pragma omp parallel for
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    dist[source] = 0;
+
+    AtomicBitmap in_queue(nNodes + 1);
+    const int nthreads = omp_get_max_threads();
+    ChunkDeque *queues[2] = { new ChunkDeque[nthreads], new ChunkDeque[nthreads] };
+
+    Chunk *first = new Chunk();
+    first->v[first->size ++] = source;
+    in_queue.test_and_set(source);
+    queues[0][0].push(first);
+
+    int round = 0;
+    bool more = true;
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        const int t = omp_get_thread_num();
+        vector<Chunk*> pool; // recycled chunks, so rounds do not allocate
+        long scanned = 0;
+
+        while (more) {
+            ChunkDeque *cur = queues[round % 2];
+            ChunkDeque *next = queues[(round + 1) % 2];
+            Chunk *out = NULL;
+            bool produced = false;
+
+            #pragma omp barrier
+            #pragma omp single
+            more = false;
+
+            while (true) {
+                Chunk *c = cur[t].pop();
+                for (int k = 1; c == NULL && k < nthreads; ++ k) {
+                    c = cur[(t + k) % nthreads].steal();
+                }
+                if (c == NULL) break;
+
+                for (int i = 0; i < c->size; ++ i) {
+                    const int vi = c->v[i];
+                    in_queue.clear(vi);
+                    const int di = dist[vi];
+                    scanned += g.degree(vi);
+
+                    for (long j = g.offsets[vi]; j < g.offsets[vi + 1]; ++ j) {
+                        const int vj = g.targets[j];
+                        if (!atomic_min(&dist[vj], di + g.weights[j])) continue;
+                        if (g.degree(vj) == 0 || !in_queue.test_and_set(vj)) continue;
+
+                        if (out == NULL) {
+                            if (pool.empty()) {
+                                out = new Chunk();
+                            } else {
+                                out = pool.back();
+                                pool.pop_back();
+                            }
+                            out->size = 0;
+                        }
+                        out->v[out->size ++] = vj;
+                        if (out->size == CHUNK_SIZE) {
+                            next[t].push(out);
+                            out = NULL;
+                            produced = true;
+                        }
+                    }
+                }
+                pool.push_back(c);
+            }
+
+            if (out != NULL) {
+                next[t].push(out);
+                produced = true;
+            }
+            if (produced) {
+                #pragma omp atomic write
+                more = true;
+            }
+            #pragma omp barrier
+
+            #pragma omp single
+            round ++;
+        }
+
+        for (size_t i = 0; i < pool.size(); ++ i) delete pool[i];
+        count_arcs(scanned);
+    } // end of parallel section
+
+    delete[] queues[0];
+    delete[] queues[1];
+}
+
+// Moore with one OpenMP task per dequeued vertex, fed from a shared queue.
+inline void moore_parallel3(int source, int nNodes, int dist[], const CSRGraph& g) {
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    dist[source] = 0;
+
+    queue<int> fifo_q;
+    fifo_q.push(source);
+
+    // Arcs scanned by the tasks each thread ran, one cache line apart, added
+    // to the shared counter once per thread after the last task
+    vector<long> scanned(omp_get_max_threads() * COUNT_STRIDE, 0);
+
+    #pragma omp parallel
+    {
+    #pragma omp single
+    {
+        // The generator pops each vertex itself before spawning its task, so
+        // a task never finds the queue empty. When the queue runs dry it
+        // waits for the tasks in flight, which are the only ones that can
+        // refill it; if it is still empty afterwards the search is done.
+        int q_size = 1;
+        while (true) {
+            if (q_size == 0) {
+                #pragma omp taskwait
+                #pragma omp critical(q_update)
+                    q_size = fifo_q.size();
+                if (q_size == 0) break;
+            }
+
+            int vi;
+            #pragma omp critical(q_update)
+            {
+                vi = fifo_q.front();
+                fifo_q.pop();
+                q_size = fifo_q.size();
+            }
+
+            #pragma omp task firstprivate(vi)
+            {
+                const int di = dist[vi];
+                for (long j = g.offsets[vi]; j < g.offsets[vi + 1]; ++ j) {
+                    const int vj = g.targets[j];
+                    const int new_dist = g.weights[j] + di;
+
+                    if (atomic_min(&dist[vj], new_dist)) {
+                        if (g.degree(vj) > 0) {
+                            #pragma omp critical(q_update)
+                                fifo_q.push(vj);
+                        }
+                    }
+                }
+                scanned[omp_get_thread_num() * COUNT_STRIDE] += g.degree(vi);
+            } // end of task
+        }
+    } // end of single section, whose barrier waits for every task
+    count_arcs(scanned[omp_get_thread_num() * COUNT_STRIDE]);
+    } // end of parallel section
+}
+
+// Delta-stepping: vertices are grouped into bins of width delta by tentative
+// distance and bins are settled in increasing order, all vertices of a bin
+// being relaxed in parallel. Relaxations land in thread-local bins, so the
+// only shared writes are the atomic-min on dist[] and one copy per thread of
+// its share of the next bin into the shared frontier.
+inline void delta_stepping(int source, int nNodes, int dist[], const CSRGraph& g, int delta) {
+    #pragma omp parallel for
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    dist[source] = 0;
+
+    vector<int> frontier(1, source);
+    long frontierSize = 1;
+    size_t currBin = 0, nextBin = NO_BIN;
+
+    #pragma omp parallel
+    {
+        vector<vector<int> > bins;
+        long scanned = 0;
+        while (currBin != NO_BIN) {
+            const long lower = (long) delta * currBin;
+            #pragma omp for schedule(dynamic, 64) nowait
+            for (long i = 0; i < frontierSize; ++ i) {
+                const int u = frontier[i];
+                const int du = dist[u];
+                if (du < lower) continue; // settled in an earlier bin already
+                scanned += g.degree(u);
+
+                for (long j = g.offsets[u]; j < g.offsets[u + 1]; ++ j) {
+                    const int vj = g.targets[j];
+                    const int new_dist = du + g.weights[j];
+                    if (atomic_min(&dist[vj], new_dist)) {
+                        const size_t bin = new_dist / delta;
+                        if (bin >= bins.size()) bins.resize(bin + 1);
+                        bins[bin].push_back(vj);
+                    }
+                }
+            }
+
+            // The current bin may have been refilled by its own light arcs,
+            // so the search starts at currBin rather than after it.
+            for (size_t b = currBin; b < bins.size(); ++ b) {
+                if (!bins[b].empty()) {
+                    #pragma omp critical(next_bin)
+                    if (b < nextBin) nextBin = b;
+                    break;
+                }
+            }
+            #pragma omp barrier
+
+            #pragma omp single
+            {
+                currBin = nextBin;
+                nextBin = NO_BIN;
+                frontierSize = 0;
+            }
+
+            long offset = 0, count = 0;
+            if (currBin != NO_BIN && currBin < bins.size()) {
+                count = bins[currBin].size();
+                #pragma omp atomic capture
+                { offset = frontierSize; frontierSize += count; }
+            }
+            #pragma omp barrier
+
+            #pragma omp single
+            frontier.resize(frontierSize);
+
+            for (long i = 0; i < count; ++ i) {
+                frontier[offset + i] = bins[currBin][i];
+            }
+            if (count > 0) bins[currBin].clear();
+            #pragma omp barrier
+        }
+        count_arcs(scanned);
+    } // end of parallel section
+}
+
+// Bin width that suits the graph when none is given: the mean arc length.
+inline int default_delta(const CSRGraph& g) {
+    double total = 0;
+    #pragma omp parallel for reduction(+:total)
+    for (long j = 0; j < g.nEdges; ++ j) {
+        total += g.weights[j];
+    }
+    const int delta = g.nEdges > 0 ? (int) (total / g.nEdges) : 1;
+    return delta > 0 ? delta : 1;
+}
+
+#endif
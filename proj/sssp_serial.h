@@ -0,0 +1,148 @@
+#ifndef PROJ_SSSP_SERIAL_H
+#define PROJ_SSSP_SERIAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <queue>
+
+#include "graph.h"
+#include "sssp.h"
+#include "heap.h"
+#include "vertex_state.h"
+
+using namespace std;
+
+// Working memory of the single-threaded engines, sized for one graph and
+// reused from query to query. Each thread running queries owns one.
+class SSSPScratch {
+public:
+    SSSPScratch(int nNodes, bool spread = true) : flags(nNodes + 1, spread), heap(nNodes, NULL) {}
+
+    VertexBitset flags; // in_queue for moore, visited for the Dijkstras
+    queue<int> fifo_q;
+    IndexedHeap heap;
+    RadixHeap radix;
+};
+
+// Runs Moore's FIFO label-correcting loop until the queue in s is empty.
+// dist[] may hold any upper bounds; vertices whose label may no longer be
+// final must already be queued (and flagged in s.flags).
+inline void moore_propagate(int dist[], const CSRGraph& g, SSSPScratch& s) {
+    VertexBitset& in_queue = s.flags;
+    queue<int>& fifo_q = s.fifo_q;
+    int vi, vj, new_dist;
+    long scanned = 0;
+    while (fifo_q.size() > 0) {
+        vi = fifo_q.front();
+        in_queue.clear(vi);
+        fifo_q.pop();
+        scanned += g.degree(vi);
+
+        for (long j = g.offsets[vi]; j < g.offsets[vi + 1]; ++ j) {
+            vj = g.targets[j];
+            new_dist = g.weights[j] + dist[vi];
+
+            if (new_dist < dist[vj] || dist[vj] == INF) {
+                dist[vj] = new_dist;
+                if (!in_queue.test(vj) && g.degree(vj) > 0) {
+                    fifo_q.push(vj);
+                    in_queue.set(vj);
+                }
+            }
+        }
+    }
+    count_arcs(scanned);
+}
+
+inline void moore(int source, int nNodes, int dist[], const CSRGraph& g, SSSPScratch& s) {
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    s.flags.clear_all();
+    dist[source] = 0;
+
+    s.fifo_q.push(source);
+    s.flags.set(source);
+    moore_propagate(dist, g, s);
+}
+
+// Dijkstra on an indexed binary heap with decrease-key.
+inline void dijkstra(int source, int nNodes, int dist[], const CSRGraph& g, SSSPScratch& s) {
+    VertexBitset& visited = s.flags;
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    visited.clear_all();
+    dist[source] = 0;
+
+    IndexedHeap& pq = s.heap;
+    pq.reset(dist);
+    pq.push_or_decrease(source);
+
+    long scanned = 0;
+    while (!pq.empty()) {
+        const int u = pq.pop();
+        visited.set(u);
+        scanned += g.degree(u);
+
+        for (long i = g.offsets[u]; i < g.offsets[u + 1]; ++ i) {
+            const int v = g.targets[i];
+            if (visited.test(v)) continue;
+            const int new_dist = g.weights[i] + dist[u];
+            if (new_dist < dist[v] || !pq.contains(v)) {
+                dist[v] = new_dist;
+                pq.push_or_decrease(v);
+            }
+        }
+    }
+    count_arcs(scanned);
+}
+
+// Dijkstra on a monotone radix heap. Improved vertices are pushed again and
+// stale entries are dropped when popped.
+inline void dijkstra_radix(int source, int nNodes, int dist[], const CSRGraph& g, SSSPScratch& s) {
+    VertexBitset& visited = s.flags;
+    for (int i = 1; i <= nNodes; ++ i) {
+        dist[i] = INF;
+    }
+    visited.clear_all();
+    dist[source] = 0;
+
+    RadixHeap& pq = s.radix;
+    pq.reset();
+    pq.push(0, source);
+
+    unsigned d;
+    long scanned = 0;
+    while (!pq.empty()) {
+        const int u = pq.pop(&d);
+        if (visited.test(u) || d != (unsigned) dist[u]) continue;
+        visited.set(u);
+        scanned += g.degree(u);
+
+        for (long i = g.offsets[u]; i < g.offsets[u + 1]; ++ i) {
+            const int v = g.targets[i];
+            if (visited.test(v)) continue;
+            const int new_dist = g.weights[i] + dist[u];
+            if (new_dist < dist[v] || dist[v] == INF) {
+                dist[v] = new_dist;
+                pq.push(new_dist, v);
+            }
+        }
+    }
+    count_arcs(scanned);
+}
+
+typedef void (*sssp_engine)(int source, int nNodes, int dist[], const CSRGraph& g, SSSPScratch& s);
+
+// Maps an engine name from the command line to its function, NULL if unknown.
+inline sssp_engine find_engine(const char *name) {
+    if (strcmp(name, "moore") == 0) return moore;
+    if (strcmp(name, "dijkstra") == 0) return dijkstra;
+    if (strcmp(name, "radix") == 0) return dijkstra_radix;
+    return NULL;
+}
+
+#endif
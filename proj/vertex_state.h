@@ -0,0 +1,84 @@
+#ifndef PROJ_VERTEX_STATE_H
+#define PROJ_VERTEX_STATE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+// Allocation of the solvers' per-vertex state (distances, queue flags).
+// Arrays come straight from anonymous mmap instead of the stack or the
+// malloc heap, so graphs with tens of millions of vertices fit; large ones
+// are marked for transparent huge pages to cut TLB misses in the scattered
+// dist[vj] accesses. Pages are placed by first touch: with spread set the
+// initial fill runs as a static OpenMP loop over the index range, the same
+// partition the engines' own "omp parallel for" loops use, so on a NUMA box
+// each thread's slice lands on its own socket. Without it the calling
+// thread touches everything, which is what a per-thread array wants.
+
+#define HUGE_PAGE_SIZE (2L << 20)
+
+inline void* vertex_alloc(size_t bytes) {
+    if (bytes == 0) bytes = 1;
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        printf("\nCannot allocate %zu bytes of vertex state!\n", bytes);
+        exit(1);
+    }
+#ifdef MADV_HUGEPAGE
+    if (bytes >= HUGE_PAGE_SIZE) madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+inline void vertex_free(void *p, size_t bytes) {
+    if (p != NULL) munmap(p, bytes == 0 ? 1 : bytes);
+}
+
+// n elements of T, all set to init. Converts to T* so it can be handed to
+// the engines wherever they take a plain array.
+template <typename T>
+class VertexArray {
+public:
+    VertexArray(long n, T init, bool spread = true) : n(n) {
+        data = (T*) vertex_alloc(n * sizeof(T));
+        if (spread) {
+            #pragma omp parallel for schedule(static)
+            for (long i = 0; i < n; ++ i) data[i] = init;
+        } else {
+            for (long i = 0; i < n; ++ i) data[i] = init;
+        }
+    }
+    ~VertexArray() { vertex_free(data, n * sizeof(T)); }
+
+    operator T*() { return data; }
+    operator const T*() const { return data; }
+
+    long n;
+    T *data;
+
+private:
+    VertexArray(const VertexArray&);
+    VertexArray& operator=(const VertexArray&);
+};
+
+// One bit per vertex for flags that are only touched by one thread at a
+// time (in_queue, visited): a 32x smaller footprint than an int array keeps
+// them cache resident. See AtomicBitmap for the shared variant.
+class VertexBitset {
+public:
+    VertexBitset(long n, bool spread = true) : words((n + 63) / 64, 0UL, spread) {}
+
+    bool test(long i) const { return (words.data[i / 64] >> (i % 64)) & 1UL; }
+    void set(long i) { words.data[i / 64] |= 1UL << (i % 64); }
+    void clear(long i) { words.data[i / 64] &= ~(1UL << (i % 64)); }
+
+    void clear_all() {
+        for (long w = 0; w < words.n; ++ w) words.data[w] = 0UL;
+    }
+
+private:
+    VertexArray<unsigned long> words;
+};
+
+#endif
@@ -1,7 +1,7 @@
 #include <stdio.h>
 #include <math.h>
+#include "bench.h"
 #define N 1000000000
-extern void timing(double* wcTime, double* cpuTime);
 
 double approx_pi() {
     double sum = 0., slice = 1.0 / N, x;
@@ -14,13 +14,20 @@ double approx_pi() {
     return 4.0 * sum; // total FP operations: 4N
 }
 
-int main() {
-    double t1, t2, cpu_t, pi;
-    timing(&t1, &cpu_t);
-    pi = approx_pi();
+void pi_call(void *arg) {
+    *(double *) arg = approx_pi();
+}
+
+int main(int argc, char **argv) {
+    double pi;
+    BenchStats st;
+    char params[64];
+
+    bench_init(argv[0]);
+    bench_stats_init(&st, 0, 4.0 * N, 0.);
+    bench_measure(&st, pi_call, &pi, 1, 0.);
     printf("Pi=%lf, sin(Pi)=%lf\n", pi, sin(pi));
-    timing(&t2, &cpu_t);
-    printf("Time spent: %lf, ", t2 - t1);
-    printf("MFlops/s = %lf\n", (4 * (N / 1000000)) / (t2 - t1));
+    sprintf(params, "N=%d", N);
+    bench_report("pi", params, 1, &st);
     return 0;
 }
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include "bench.h"
+
+#define MIN_TIME 0.25  // seconds each sample runs for at least
 
-extern void timing(double* wcTime, double* cpuTime);
 extern void dummy();
 
 void kernel(int N, double a[], double b[], double c[], double d[]) {
@@ -22,31 +24,33 @@ double* init(int N) {
     return arr;
 }
 
-int main() {
-    int k, r, repeat;
+typedef struct triad_t {
     long N;
-    double wcs, wce, ct, runtime;
     double *a, *b, *c, *d;
+} Triad;
 
-    for (k = 3; k <= 24; k++) {
-        N = floor(pow(2.1, k));
-        a = init(N), b = init(N), c = init(N), d = init(N);
-        runtime = 0.;
-        repeat = 1;
-        while (runtime < 1.0) {
-            timing(&wcs, &ct);
-            for (r = 0; r < repeat; r++) {
-                kernel(N, a, b, c, d);
-                if (a[N>>1] < 0.) { dummy(); }  // fool the compiler
-            }
-            timing(&wce, &ct);
-            runtime = wce - wcs;
-            repeat *= 2;
-        }
-        repeat /= 2;
-        // 2 * N * repeat FP operations in total
-        printf("N=%ld, log(N) = %d, MFlops/s = %2.1lf G, repeat=%d, runtime=%lf\n", N, k, (2 * N * repeat/pow(10, 9)) / runtime, repeat, runtime);
+void triad(void *arg) {
+    Triad *t = (Triad *) arg;
+    kernel(t->N, t->a, t->b, t->c, t->d);
+    if (t->a[t->N>>1] < 0.) { dummy(); }  // fool the compiler
+}
 
+int main(int argc, char **argv) {
+    int k;
+    Triad t;
+    BenchStats st;
+    char params[64];
+
+    bench_init(argv[0]);
+    for (k = 3; k <= 24; k++) {
+        t.N = floor(pow(2.1, k));
+        t.a = init(t.N), t.b = init(t.N), t.c = init(t.N), t.d = init(t.N);
+        // 2 FP operations and 4 doubles moved per element
+        bench_stats_init(&st, 1, 2.0 * t.N, 32.0 * t.N);
+        bench_measure(&st, triad, &t, 3, MIN_TIME);
+        sprintf(params, "N=%ld", t.N);
+        bench_report("triad", params, 1, &st);
+        free(t.a), free(t.b), free(t.c), free(t.d);
     }
     return 0;
 }
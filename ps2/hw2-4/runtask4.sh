@@ -0,0 +1,30 @@
+#!/bin/bash
+#PBS -l procs=4,tpn=2,mem=68gb
+#PBS -l walltime=2:00
+#PBS -N Task4
+#PBS -r n
+#PBS -j oe
+#PBS -q cpsc424
+
+# Load necessary module files
+module load Langs/Intel/15 MPI/OpenMPI/1.8.6-intel15
+
+# Print initial working directory
+pwd
+
+# Change to submission directory
+cd $PBS_O_WORKDIR
+
+# Now print the current working directory
+pwd
+
+# Print the node list
+cat $PBS_NODEFILE
+
+# Run the program 3 times: 9 tasks, 2 in flight per worker
+time mpiexec -n 4 task4 9 2
+time mpiexec -n 4 task4 9 2
+time mpiexec -n 4 task4 9 2
+
+# One task at a time, for comparison
+time mpiexec -n 4 task4 9 1
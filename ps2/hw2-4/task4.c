@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "mpi.h"
+#include "mwsched.h"
+
+/*
+  Task 3 on the dynamic scheduler of ../mwsched.h. Instead of one rwork()
+  per worker, handed out in rank order, there is a queue of ntasks calls,
+  each with the load rwork() gives to one of the ranks of task 3, and the
+  workers take them from the queue as they finish the last. The master
+  keeps the messages and prints them in task order at the end, with the
+  utilisation of each worker.
+
+  Usage: task4 [ntasks (3 per worker)] [tasks in flight per worker (2)]
+*/
+
+typedef struct task_arg_t {
+  int sparm;
+  int workers;
+  char (*cache)[100];  // message of each task, on the master
+} TaskArg;
+
+int rwork(int,int);
+
+int do_task(int task, void *arg) {
+  TaskArg *a = (TaskArg *) arg;
+  return rwork(1 + task % a->workers, a->sparm); // Simulate some work
+}
+
+void got_result(int task, int worker, int worktime, void *arg) {
+  TaskArg *a = (TaskArg *) arg;
+  sprintf(a->cache[task], "Hello master, from process %d after working %d seconds on task %d", worker, worktime, task);
+}
+
+int main(int argc, char **argv ) {
+
+  int i, rank, size, ntasks, depth;
+  double wct0, wct1, total_time;
+  TaskArg arg;
+  MwStats st;
+
+  MPI_Init(&argc,&argv); // Required MPI initialization call
+
+  MPI_Comm_size(MPI_COMM_WORLD,&size); // Get no. of processes
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
+
+  ntasks = argc > 1 ? atoi(argv[1]) : 3 * (size - 1);
+  depth = argc > 2 ? atoi(argv[2]) : 2;
+  arg.workers = size - 1;
+  arg.cache = NULL;
+
+  if (rank == 0) {
+    arg.sparm = rwork(0,0); //initialize the workers' work times
+    arg.cache = (char (*)[100]) malloc((ntasks > 0 ? ntasks : 1) * 100);
+    if (arg.cache == NULL) {
+      printf("Cannot allocate %d messages!\n", ntasks);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+  }
+  MPI_Bcast(&arg.sparm, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  MPI_Barrier(MPI_COMM_WORLD); //wait for everyone to be ready before starting timer
+  wct0 = MPI_Wtime(); //set the start time
+
+  mw_run(ntasks, depth, do_task, NULL, got_result, &arg, &st);
+
+  if (rank == 0) {
+    for (i=0; i<ntasks; i++) {
+      printf("Message for task %d: %s\n", i, arg.cache[i]);
+    }
+
+    wct1 = MPI_Wtime(); // Get total elapsed time
+    total_time = wct1 - wct0;
+    printf("Message printed by master: Total elapsed time is %f seconds (%d tasks, %d in flight per worker).\n",
+           total_time, ntasks, depth);
+    mw_report(&st);
+    free(arg.cache);
+  }
+  mw_free(&st);
+
+  MPI_Finalize(); // Required MPI termination call
+  return 0;
+}
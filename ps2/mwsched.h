@@ -0,0 +1,175 @@
+#ifndef PS2_MWSCHED_H
+#define PS2_MWSCHED_H
+
+/*
+  Master/worker scheduler with a dynamic task queue. Rank 0 hands out the
+  task numbers 0..n-1 and every other rank calls work(task, arg) on the
+  ones it gets. A worker that finishes gets the next task in the queue, so
+  a slow task only holds up its own worker and the run ends close to the
+  average load rather than at the largest one.
+
+  Each worker keeps depth receives posted, so up to depth tasks are on
+  their way to it or waiting there, and it starts the next one as soon as
+  it has sent back the result of the last, without a round trip to the
+  master. The master takes the results from MPI_ANY_SOURCE in the order
+  they complete and refills the worker that sent each one. A larger depth
+  hides more of the master's latency, at the price of tasks bound to a
+  worker early; depth 1 is the plain one-task-at-a-time queue.
+
+  All ranks call mw_run() with the same n and depth; only rank 0 gets the
+  results and the statistics.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpi.h"
+
+#define MW_TAG_TASK 98
+#define MW_TAG_RESULT 97
+#define MW_STOP -1  // task number that ends a worker
+
+typedef int (*MwWork)(int task, void *arg);
+// Called by the master on each result as it comes in
+typedef void (*MwDone)(int task, int worker, int result, void *arg);
+
+typedef struct mw_stats_t {
+  int workers;
+  double elapsed;  // seconds from the first task out to the last result in
+  int *tasks;  // tasks done, per rank (0 is the master)
+  double *busy;  // seconds in work(), per rank
+} MwStats;
+
+static void mw_die(const char *why) {
+  printf("Scheduler: %s!\n", why);
+  MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+static void mw_send(int task, int worker) {
+  MPI_Send(&task, 1, MPI_INT, worker, MW_TAG_TASK, MPI_COMM_WORLD);
+}
+
+static void mw_master(int n, int depth, int size, int *results, MwDone done, void *arg, MwStats *st) {
+  int *inflight = (int *) calloc(size, sizeof(int));
+  int next = 0, finished = 0, d, w, task;
+  double msg[3];  // task, result, seconds of work
+  MPI_Status status;
+
+  if (inflight == NULL) mw_die("cannot allocate the queue");
+  st->elapsed = MPI_Wtime();
+
+  // round robin, so that fewer than depth tasks per worker still spread out
+  for (d = 0; d < depth; d++)
+    for (w = 1; w < size && next < n; w++) {
+      mw_send(next++, w);
+      inflight[w]++;
+    }
+  for (w = 1; w < size; w++)
+    if (inflight[w] == 0) mw_send(MW_STOP, w);
+
+  while (finished < n) {
+    MPI_Recv(msg, 3, MPI_DOUBLE, MPI_ANY_SOURCE, MW_TAG_RESULT, MPI_COMM_WORLD, &status);
+    w = status.MPI_SOURCE;
+    task = (int) msg[0];
+    inflight[w]--;
+    // refill before anything else, so the worker never runs dry on our account
+    if (next < n) {
+      mw_send(next++, w);
+      inflight[w]++;
+    } else if (inflight[w] == 0) {
+      mw_send(MW_STOP, w);
+    }
+
+    finished++;
+    st->tasks[w]++;
+    st->busy[w] += msg[2];
+    if (results != NULL) results[task] = (int) msg[1];
+    if (done != NULL) done(task, w, (int) msg[1], arg);
+  }
+
+  st->elapsed = MPI_Wtime() - st->elapsed;
+  free(inflight);
+}
+
+static void mw_worker(int depth, MwWork work, void *arg) {
+  int *task = (int *) malloc(depth * sizeof(int));
+  MPI_Request *req = (MPI_Request *) malloc(depth * sizeof(MPI_Request));
+  int s, k;
+  double msg[3], t0;
+
+  if (task == NULL || req == NULL) mw_die("cannot allocate the receives");
+  for (s = 0; s < depth; s++)
+    MPI_Irecv(&task[s], 1, MPI_INT, 0, MW_TAG_TASK, MPI_COMM_WORLD, &req[s]);
+
+  // receives from one source match in the order they were posted, so
+  // going round the slots takes the tasks in the order they were sent
+  for (s = 0; ; s = (s + 1) % depth) {
+    MPI_Wait(&req[s], MPI_STATUS_IGNORE);
+    if (task[s] == MW_STOP) break;
+
+    t0 = MPI_Wtime();
+    msg[1] = work(task[s], arg);
+    msg[2] = MPI_Wtime() - t0;
+    msg[0] = task[s];
+    MPI_Send(msg, 3, MPI_DOUBLE, 0, MW_TAG_RESULT, MPI_COMM_WORLD);
+    MPI_Irecv(&task[s], 1, MPI_INT, 0, MW_TAG_TASK, MPI_COMM_WORLD, &req[s]);
+  }
+
+  // the stop comes after our last task, so nothing is left for the others
+  for (k = 0; k < depth; k++)
+    if (k != s) {
+      MPI_Cancel(&req[k]);
+      MPI_Wait(&req[k], MPI_STATUS_IGNORE);
+    }
+  free(task);
+  free(req);
+}
+
+// Runs tasks 0..n-1 over the workers; on rank 0, results[task] (if not
+// NULL) gets what work() returned, and st the time and load of each rank
+static inline void mw_run(int n, int depth, MwWork work, int *results, MwDone done, void *arg, MwStats *st) {
+  int rank, size;
+
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  if (size < 2) mw_die("needs at least one worker");
+  if (depth < 1) depth = 1;
+
+  memset(st, 0, sizeof(MwStats));
+  st->workers = size - 1;
+  if (rank == 0) {
+    st->tasks = (int *) calloc(size, sizeof(int));
+    st->busy = (double *) calloc(size, sizeof(double));
+    if (st->tasks == NULL || st->busy == NULL) mw_die("cannot allocate the statistics");
+    mw_master(n, depth, size, results, done, arg, st);
+  } else {
+    mw_worker(depth, work, arg);
+  }
+}
+
+// Prints tasks, busy time and utilisation (busy / elapsed) of each worker
+static inline void mw_report(const MwStats *st) {
+  double total = .0, most = .0;
+  int w;
+
+  if (st->tasks == NULL) return;  // not the master
+  printf("%6s %6s %10s %8s\n", "Worker", "Tasks", "Busy, s", "Util");
+  for (w = 1; w <= st->workers; w++) {
+    printf("%6d %6d %10.3f %7.1f%%\n", w, st->tasks[w], st->busy[w],
+           st->elapsed > .0 ? 100. * st->busy[w] / st->elapsed : .0);
+    total += st->busy[w];
+    if (st->busy[w] > most) most = st->busy[w];
+  }
+  printf("Elapsed %.3f s, mean load %.3f s, largest load %.3f s, utilisation %.1f%%\n",
+         st->elapsed, total / st->workers, most,
+         st->elapsed > .0 ? 100. * total / (st->workers * st->elapsed) : .0);
+}
+
+static inline void mw_free(MwStats *st) {
+  free(st->tasks);
+  free(st->busy);
+  st->tasks = NULL;
+  st->busy = NULL;
+}
+
+#endif
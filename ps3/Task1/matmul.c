@@ -1,4 +1,5 @@
 #include "timing.h"
+#include "trimm.h"
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
 double matmul(int N, double* A, double* B, double* C) {
@@ -12,22 +13,27 @@ double matmul(int N, double* A, double* B, double* C) {
 
 */
 
-  int i, j, k;
-  int iA, iB, iC;
+  int i;
   double wctime0, wctime1, cputime;
+  double **rows, **cols;
+  int *idx;
 
   timing(&wctime0, &cputime);
 
-// This loop computes the matrix-matrix product
-  iC = 0;
+// Row i of A and column i of B both start at i*(i+1)/2; the blocked kernel
+// in trimm.h skips the known-0 entries tile by tile
+  rows = (double **) malloc(N * sizeof(double *));
+  cols = (double **) malloc(N * sizeof(double *));
+  idx = (int *) malloc(N * sizeof(int));
   for (i=0; i<N; i++) {
-    iA = i*(i+1)/2; // initializes row pointer in A
-    for (j=0; j<N; j++,iC++) {
-      iB = j*(j+1)/2; // initializes column pointer in B
-      C[iC] = 0.;
-      for (k=0; k<=MIN(i,j); k++) C[iC] += A[iA+k] * B[iB+k]; // avoids using known-0 entries 
-    }
+    rows[i] = A + (long) i*(i+1)/2;
+    cols[i] = B + (long) i*(i+1)/2;
+    idx[i] = i;
   }
+  trimm_packed_omp(N, rows, idx, N, cols, idx, C, N);
+  free(rows);
+  free(cols);
+  free(idx);
 
   timing(&wctime1, &cputime);
   return(wctime1 - wctime0);
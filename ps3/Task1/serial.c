@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "bench.h"
 double matmul(int, double*, double*, double*);
 
 int main(int argc, char **argv) {
@@ -21,9 +22,15 @@ int main(int argc, char **argv) {
 
   int sizes[5]={1000,2000,4000,8000,12000};
 
-  double wctime;
+  double wctime, flops;
+  int threads[BENCH_MAX_THREADS], nThreads, t;
+  BenchStats st;
+  char params[64];
 
-  printf("Matrix multiplication times:\n   N      TIME (secs)\n -----   -------------\n");
+  bench_init(argv[0]);
+  nThreads = bench_threads(threads);
+
+  printf("Matrix multiplication times:\n   N   THREADS   TIME (secs)\n -----  -------  -------------\n");
   for (run=0; run<5; run++) {
     N = sizes[run];
 
@@ -40,9 +47,18 @@ int main(int argc, char **argv) {
     for (i=0; i<sizeAB; i++) A[i] = ((double) rand()/(double)RAND_MAX);
     for (i=0; i<sizeAB; i++) B[i] = ((double) rand()/(double)RAND_MAX);
 
-    wctime = matmul(N, A, B, C);
-
-    printf ("  %5d    %9.4f\n", N, wctime);
+    // C(i,j) takes min(i,j)+1 multiply-adds
+    flops = 0.;
+    for (i=0; i<N; i++) flops += 2.0 * (i+1) * (2*(N-i)-1);
+    sprintf(params, "N=%d", N);
+    for (t=0; t<nThreads; t++) {
+      bench_set_threads(threads[t]);
+      wctime = matmul(N, A, B, C);
+      printf ("  %5d  %7d    %9.4f\n", N, threads[t], wctime);
+      bench_stats_init(&st, 0, flops, 8.0 * (2.0*sizeAB + sizeC));
+      bench_add(&st, wctime, 1);
+      bench_report("trimm", params, threads[t], &st);
+    }
 
     // for (i = 0; i < N; ++i) {
     //   for (j = 0; j < N; ++j) {
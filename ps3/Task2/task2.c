@@ -5,9 +5,9 @@
 #include <unistd.h> 
 #include <math.h>
 #include <mpi.h>
+#include "trimm.h"
 
 #define CACHE_SIZE 64000000
-#define BLK_SIZE 20000000
 #define TAG_ROW 11
 #define TAG_COL 22
 #define TAG_RESULT 33
@@ -29,27 +29,30 @@ int group_index_start(int size, int idx) {
 }
 
 double dense_matmul(int N, int size, int gi, int gj, double gA[], double gB[], double ret[]) {
-  int i, j, si, sj, k, dst, src;
-  double gC[BLK_SIZE];
+  int i;
+  double **rows, **cols;
+  int *rowk, *colk;
   double wct;
   // gA(k) countains row [k*size, (k+1)*size)
   wct = MPI_Wtime();
+  rows = (double **) malloc(size * sizeof(double *));
+  cols = (double **) malloc(size * sizeof(double *));
+  rowk = (int *) malloc(size * sizeof(int));
+  colk = (int *) malloc(size * sizeof(int));
   for (i = 0; i < size; ++i) {
-    for (j = 0; j < size; ++j) {
-      gC[i*size+j] = 0.0;
-      si = gi * size * i + (1 + i) * i / 2;
-      sj = gj * size * j + (1 + j) * j / 2;
-      for (k = 0; k < MIN(gi * size + i, gj * size + j) + 1; ++k) {
-        gC[i*size+j] += gA[si+k] * gB[sj+k];
-      }
-    }
+    rows[i] = gA + gi * size * i + (1 + i) * i / 2;
+    cols[i] = gB + gj * size * i + (1 + i) * i / 2;
+    rowk[i] = gi * size + i;
+    colk[i] = gj * size + i;
   }
 
-  for (i = 0; i < size; ++i) {
-      dst = i * N + gj * size; // gj <- col in the outer scope
-      src = i * size;
-      for (k = 0; k < size; ++k) { ret[dst+k] = gC[src+k]; }
-  }
+  // results go straight into the gj-th column block of ret
+  trimm_packed_omp(size, rows, rowk, size, cols, colk, ret + gj * size, N);
+
+  free(rows);
+  free(cols);
+  free(rowk);
+  free(colk);
   return MPI_Wtime() - wct;
 }
 
@@ -63,7 +66,7 @@ int main(int argc, char **argv) {
 
   MPI_Status status;
 
-  int np, size, rank;
+  int np, size, rank, provided;
   int g_start, g_len;
 
   double gA[CACHE_SIZE], gB[CACHE_SIZE], ret[CACHE_SIZE];
@@ -75,7 +78,7 @@ int main(int argc, char **argv) {
   }
   N = atoi(argv[1]);
 
-  MPI_Init(&argc, &argv); // Required MPI initialization call
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // only the master thread calls MPI
   MPI_Comm_size(MPI_COMM_WORLD, &np); // Get no. of processes
   MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
 
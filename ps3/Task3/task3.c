@@ -5,9 +5,9 @@
 #include <unistd.h> 
 #include <math.h>
 #include <mpi.h>
+#include "trimm.h"
 
 #define CACHE_SIZE 8000000
-#define BLK_SIZE 1000000
 #define TAG_ROW 11
 #define TAG_COL 22
 #define TAG_RESULT 33
@@ -30,27 +30,30 @@ int group_index_start(int size, int idx) {
 }
 
 double dense_matmul(int N, int size, int gi, int gj, double gA[], double gB[], double ret[]) {
-  int i, j, si, sj, k, dst, src;
-  double gC[BLK_SIZE];
+  int i;
+  double **rows, **cols;
+  int *rowk, *colk;
   double wct;
   // gA(k) countains row [k*size, (k+1)*size)
   wct = MPI_Wtime();
+  rows = (double **) malloc(size * sizeof(double *));
+  cols = (double **) malloc(size * sizeof(double *));
+  rowk = (int *) malloc(size * sizeof(int));
+  colk = (int *) malloc(size * sizeof(int));
   for (i = 0; i < size; ++i) {
-    for (j = 0; j < size; ++j) {
-      gC[i*size+j] = 0.0;
-      si = gi * size * i + (1 + i) * i / 2;
-      sj = gj * size * j + (1 + j) * j / 2;
-      for (k = 0; k < MIN(gi * size + i, gj * size + j) + 1; ++k) {
-        gC[i*size+j] += gA[si+k] * gB[sj+k];
-      }
-    }
+    rows[i] = gA + gi * size * i + (1 + i) * i / 2;
+    cols[i] = gB + gj * size * i + (1 + i) * i / 2;
+    rowk[i] = gi * size + i;
+    colk[i] = gj * size + i;
   }
 
-  for (i = 0; i < size; ++i) {
-      dst = i * N + gj * size; // gj <- col in the outer scope
-      src = i * size;
-      for (k = 0; k < size; ++k) { ret[dst+k] = gC[src+k]; }
-  }
+  // results go straight into the gj-th column block of ret
+  trimm_packed_omp(size, rows, rowk, size, cols, colk, ret + gj * size, N);
+
+  free(rows);
+  free(cols);
+  free(rowk);
+  free(colk);
   return MPI_Wtime() - wct;
 }
 
@@ -70,21 +73,23 @@ int main(int argc, char **argv) {
   int col; // col-group index
 
   MPI_Status status;
-  MPI_Request send_reqs[MAX_NP], recv_reqs[MAX_NP];
+  MPI_Request send_reqs[MAX_NP], recv_reqs[MAX_NP]; // one persistent pair per ring step
+  MPI_Win win;
 
-  int np, size, rank;
-  int g_start, g_len;
+  int np, size, rank, provided;
+  int g_start, g_len, cur, use_put;
 
-  double gA[CACHE_SIZE], gB[CACHE_SIZE], ret[CACHE_SIZE];
-  double nB[CACHE_SIZE]; // used as recving cache of column groups
+  double gA[CACHE_SIZE], ret[CACHE_SIZE];
+  double gB[2][CACHE_SIZE]; // column groups, one in use while the other is received
 
   if (argc <= 1) {
     printf("Please specify size of multiplied matrices!\n");
     exit(1);
   }
   N = atoi(argv[1]);
+  use_put = argc > 2 && strcmp(argv[2], "put") == 0; // one-sided ring instead of send/recv
 
-  MPI_Init(&argc, &argv); // Required MPI initialization call
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // only the master thread calls MPI
   MPI_Comm_size(MPI_COMM_WORLD, &np); // Get no. of processes
   MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
 
@@ -110,10 +115,10 @@ int main(int argc, char **argv) {
       g_start = group_index_start(size, i);
       g_len = group_length(size, i);
       for (j = 0; j < g_len; ++j) { gA[j] = A[g_start + j]; }
-      for (j = 0; j < g_len; ++j) { gB[j] = B[g_start + j]; }
+      for (j = 0; j < g_len; ++j) { gB[0][j] = B[g_start + j]; }
       wct = MPI_Wtime();
       MPI_Send(gA, g_len, MPI_DOUBLE, i, TAG_ROW, MPI_COMM_WORLD);
-      MPI_Send(gB, g_len, MPI_DOUBLE, i, TAG_COL, MPI_COMM_WORLD);
+      MPI_Send(gB[0], g_len, MPI_DOUBLE, i, TAG_COL, MPI_COMM_WORLD);
       cmt += MPI_Wtime() - wct;
     }
     
@@ -122,40 +127,60 @@ int main(int argc, char **argv) {
   g_len = group_length(size, rank);
   wct = MPI_Wtime();
   MPI_Recv(gA, g_len, MPI_DOUBLE, 0, TAG_ROW, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  MPI_Recv(gB, group_length(size, rank), MPI_DOUBLE, 0, TAG_COL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Recv(gB[0], group_length(size, rank), MPI_DOUBLE, 0, TAG_COL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
   cmt += MPI_Wtime() - wct;
 
+  // Step j multiplies by col group (rank - j) mod np from gB[j % 2]. That group
+  // goes on to succ while the next one arrives from prev into gB[(j + 1) % 2],
+  // both started before the multiply, so the transfer hides behind it. Each
+  // step's length is known up front, so all requests are set up once here.
+  if (use_put) {
+    MPI_Win_create(gB, 2 * CACHE_SIZE * sizeof(double), sizeof(double), MPI_INFO_NULL, MPI_COMM_WORLD, &win);
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, win);
+  } else {
+    col = rank;
+    for (j = 0; j < np - 1; ++j) {
+      MPI_Send_init(gB[j % 2], group_length(size, col), MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[j]);
+      MPI_Recv_init(gB[(j + 1) % 2], group_length(size, prev(col, np)), MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[j]);
+      col = prev(col, np);
+    }
+  }
+
   col = rank;
   for (j = 0; j < np; ++j) {
-    MPI_Irecv(nB, group_length(size, prev(col, np)), MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[rank]);
-    cpt += dense_matmul(N, size, rank, col, gA, gB, ret);
-    MPI_Isend(gB, group_length(size, col), MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[rank]);
-    cmt += MPI_Wait_Timed(&send_reqs[rank]);
+    cur = j % 2;
+    if (j < np - 1) { // the last group is not needed by anyone
+      if (use_put) {
+        g_len = group_length(size, col);
+        MPI_Put(gB[cur], g_len, MPI_DOUBLE, succ(rank, np), (MPI_Aint) (1 - cur) * CACHE_SIZE, g_len, MPI_DOUBLE, win);
+      } else {
+        MPI_Start(&recv_reqs[j]);
+        MPI_Start(&send_reqs[j]);
+      }
+    }
+
+    cpt += dense_matmul(N, size, rank, col, gA, gB[cur], ret);
 
+    if (j < np - 1) {
+      if (use_put) {
+        wct = MPI_Wtime();
+        MPI_Win_fence(0, win); // own puts done, and prev's put into gB[1 - cur] too
+        cmt += MPI_Wtime() - wct;
+      } else {
+        cmt += MPI_Wait_Timed(&send_reqs[j]);
+        cmt += MPI_Wait_Timed(&recv_reqs[j]);
+      }
+    }
     col = prev(col, np);
-    cmt += MPI_Wait_Timed(&recv_reqs[rank]);
-    memcpy(gB, nB, CACHE_SIZE * sizeof(double));
-    // if (rank % 2) {
-    //   MPI_Irecv(nB, group_length(size, prev(col, np)), MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[rank]);
-    // } else {
-    //   MPI_Isend(gB, group_length(size, col), MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[rank]);
-    // }
-
-    // cpt += dense_matmul(N, size, rank, col, gA, gB, ret);
-    // if (j == np-1) break;
-    
-    // if (rank % 2) {
-    //   cmt += MPI_Wait_Timed(&recv_reqs[rank]);
-    //   MPI_Isend(gB, group_length(size, col), MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[rank]);
-    //   cmt += MPI_Wait_Timed(&send_reqs[rank]);
-    // } else {
-    //   cmt += MPI_Wait_Timed(&send_reqs[rank]);
-    //   MPI_Irecv(nB, group_length(size, prev(col, np)), MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[rank]);
-    //   cmt += MPI_Wait_Timed(&recv_reqs[rank]);
-    // }
-    
-    // col = prev(col, np);
-    // memcpy(gB, nB, CACHE_SIZE * sizeof(double));
+  }
+
+  if (use_put) {
+    MPI_Win_free(&win);
+  } else {
+    for (j = 0; j < np - 1; ++j) {
+      MPI_Request_free(&send_reqs[j]);
+      MPI_Request_free(&recv_reqs[j]);
+    }
   }
 
   // send back row groups result
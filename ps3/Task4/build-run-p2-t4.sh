@@ -0,0 +1,18 @@
+#!/bin/bash
+#PBS -l procs=8,tpn=4,mem=34gb
+#PBS -l walltime=30:00
+#PBS -N Task4
+#PBS -r n
+#PBS -j oe
+#PBS -q fas_devel
+
+module load Langs/Intel/15 MPI/OpenMPI/1.8.6-intel15
+pwd
+cd $PBS_O_WORKDIR
+pwd
+cat $PBS_NODEFILE
+make clean
+make task4
+# One rank per node, the 4 cores of each node shared by OpenMP threads
+export OMP_NUM_THREADS=4
+time mpiexec -n 2 -npernode 1 --bind-to none -x OMP_NUM_THREADS ./task4 4000
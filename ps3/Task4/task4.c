@@ -5,47 +5,147 @@
 #include <unistd.h> 
 #include <math.h>
 #include <mpi.h>
+#include "trimm.h"
 
-#define CACHE_SIZE 64000000 // max((N*N)/(2*NP)) 32000000
-#define BLK_SIZE 20000000 // 2000000
-#define TAG_ROW 11
 #define TAG_COL 22
-#define TAG_RESULT 33
 #define TAG_PARTITION 44
-#define MAX_NP 8
-#define MAX_SIZE 4000
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
 int prev(int col, int limit) { return (col-1>=0) ? col-1 : limit-1; }
 int succ(int col, int limit) { return (col+1<limit) ? col+1 : 0; }
-int rc_start(int rc_num) { return rc_num * (rc_num + 1) / 2; }
 
-double dense_matmul(int N, int psize_row, int psize_col, 
-    int row_partition[], int col_partition[], double gA[], double gB[], double ret[]) {
-  int i, j, si, sj, k, dst, src;
-  double gC[BLK_SIZE];
+// no. of packed values in a group of n rows (or cols)
+int group_len(int part[], int n) {
+  int k, len = 0;
+  for (k = 0; k < n; ++k) len += part[k] + 1;
+  return len;
+}
+
+// Rows (and cols) are dealt out as i, N-1-i, i+1, N-2-i, ... in groups of
+// size, so every group gets about the same share of the triangle. Each rank
+// builds the same table, group ip at partitions[ip*size ...].
+void make_partitions(int N, int np, int size, int partitions[], int psizes[]) {
+  int i, j, k, ip;
+  i = 0;
+  j = N - 1;
+  for (ip = 0; ip < np; ++ip) {
+    int *part = partitions + (long) ip * size;
+    k = 0; // partition cache pointer
+    while (i <= j) {
+      if (i <= j && k < size) {
+        part[k] = i;
+        k += 1;
+        i += 1;
+      } else break;
+      if (i <= j && k < size) {
+        part[k] = j;
+        k += 1;
+        j -= 1;
+      } else break;
+    }
+    psizes[ip] = k;
+  }
+}
+
+// C arrives with row perm[p] at position p; moves every row home in place by
+// following the cycles of perm, with one spare row tmp.
+void place_rows(double C[], int N, int perm[], double tmp[]) {
+  int s, p, k;
+  double t;
+  char *done = (char *) calloc(N, 1);
+  for (s = 0; s < N; ++s) {
+    if (done[s]) continue;
+    memcpy(tmp, C + (long) s * N, N * sizeof(double));
+    p = s;
+    do {
+      p = perm[p];
+      for (k = 0; k < N; ++k) {
+        t = C[(long) p * N + k];
+        C[(long) p * N + k] = tmp[k];
+        tmp[k] = t;
+      }
+      done[p] = 1;
+    } while (p != s);
+  }
+  free(done);
+}
+
+// Working memory of one rank, carved out of a single pool when N and np are
+// known and reused by every ring step. A group holds at most size rows, paired
+// as i and N-1-i with N+1 values per pair, which bounds every row or column
+// message by cap doubles. Column groups are double buffered: the halves of
+// colbuf and partbuf take turns as the current group and the incoming one.
+typedef struct {
+  double *pool;
+  double *gA, *gB, *nB; // own rows, current cols, cols arriving from prev rank
+  double *colbuf; // 2 x cap, gB and nB point into it
+  double *ret;  // size x N block of C owned by this rank
+  double *gC;   // size x size product of one ring step
+  double **rows, **cols;
+  int *row_partition, *col_partition, *new_col_part;
+  int *partbuf; // 2 x size, col_partition and new_col_part point into it
+  int cap, size;
+} buffers;
+
+// ring step j multiplies by half j % 2 and receives into the other one
+void buffers_select(buffers *b, int j) {
+  int cur = j % 2;
+  b->gB = b->colbuf + (long) cur * b->cap;
+  b->nB = b->colbuf + (long) (1 - cur) * b->cap;
+  b->col_partition = b->partbuf + cur * b->size;
+  b->new_col_part = b->partbuf + (1 - cur) * b->size;
+}
+
+void buffers_alloc(buffers *b, int N, int size) {
+  long total;
+  b->cap = (size + 1) / 2 * (N + 1);
+  b->size = size;
+  total = 3L * b->cap + (long) size * N + (long) size * size;
+  b->pool = (double *) malloc(total * sizeof(double));
+  b->rows = (double **) malloc(2 * size * sizeof(double *));
+  b->row_partition = (int *) malloc(3 * size * sizeof(int));
+  if (b->pool == NULL || b->rows == NULL || b->row_partition == NULL) {
+    printf("Cannot allocate %ld doubles of working memory!\n", total);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  b->gA = b->pool;
+  b->colbuf = b->gA + b->cap;
+  b->ret = b->colbuf + 2L * b->cap;
+  b->gC = b->ret + (long) size * N;
+  b->cols = b->rows + size;
+  b->partbuf = b->row_partition + size;
+  buffers_select(b, 0);
+}
+
+void buffers_free(buffers *b) {
+  free(b->pool);
+  free(b->rows);
+  free(b->row_partition);
+}
+
+double dense_matmul(int N, int psize_row, int psize_col, buffers *b) {
+  int i, j, si, sj;
+  long src;
   double wct;
 
   wct = MPI_Wtime();
-  dst = 0;
+  // rows and cols of the partitions are packed back to back, row_partition[i]+1 values each
   si = 0;
   for (i = 0; i < psize_row; ++i) {
-    sj = 0;
-    for (j = 0; j < psize_col; ++j) {
-      gC[dst] = 0.0;
-      for (k = 0; k <= MIN(row_partition[i], col_partition[j]); ++k) {
-        gC[dst] += gA[si+k] * gB[sj+k];
-      }
-      dst += 1;
-      sj += col_partition[j] + 1;
-    }
-    si += row_partition[i] + 1;
+    b->rows[i] = b->gA + si;
+    si += b->row_partition[i] + 1;
+  }
+  sj = 0;
+  for (j = 0; j < psize_col; ++j) {
+    b->cols[j] = b->gB + sj;
+    sj += b->col_partition[j] + 1;
   }
+  trimm_packed_omp(psize_row, b->rows, b->row_partition, psize_col, b->cols, b->col_partition, b->gC, psize_col);
   
   src = 0;
   for (i = 0; i < psize_row; ++i) {
     for (j = 0; j < psize_col; ++j) {
-      ret[i*N + col_partition[j]] = gC[src++];
+      b->ret[(long) i*N + b->col_partition[j]] = b->gC[src++];
     }
   }
 
@@ -61,44 +161,65 @@ double MPI_Wait_Timed(MPI_Request *request) {
 
 int main(int argc, char **argv) {
 
-  int N, i, j, k, si, sj, ip, sum;
-  double *A, *B, *C;
-  int sizeAB, sizeC, dst, src, flag, counter;
+  int N, i, j, k, ip;
+  double *A = NULL, *B = NULL, *C = NULL; // only allocated on master
+  long sizeAB, sizeC, *rowoff;
   double cpt = 0.0, cmt = 0.0, wct; // compute-time, communicate-time, wall-clock-time
   int col; // col-group index
 
-  MPI_Status status;
-  MPI_Request send_reqs[MAX_NP][2], recv_reqs[MAX_NP][2]; // [0] for data, [1] for partition number
+  MPI_Request send_reqs[2][2], recv_reqs[2][2]; // [half][0] for data, [half][1] for partition number
+  MPI_Win win, pwin;
+  MPI_Datatype row_type;
 
-  int np, rank;
-  int size, length, last_size, last_length;
-  int rank_len, g_len, p_len, prev_gl, prev_pl;
+  int np, rank, provided;
+  int size, last_size;
+  int rank_len, g_len, p_len, cur, use_put;
 
-  double gA[CACHE_SIZE], gB[CACHE_SIZE], ret[CACHE_SIZE];
-  double nB[CACHE_SIZE]; // used as recving cache of column groups
-  int partitions[MAX_NP][MAX_SIZE];
-  int row_partition[MAX_SIZE], col_partition[MAX_SIZE], new_col_part[MAX_SIZE];
-  int psizes[MAX_NP];
+  buffers buf;
+  int *partitions; // np groups of up to size rows
+  int *psizes, *counts, *displs, *row_displs;
 
   if (argc <= 1) {
     printf("Please specify size of multiplied matrices!\n");
     exit(1);
   }
   N = atoi(argv[1]);
+  use_put = argc > 2 && strcmp(argv[2], "put") == 0; // one-sided ring instead of send/recv
 
-  MPI_Init(&argc, &argv); // Required MPI initialization call
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // only the master thread calls MPI
   MPI_Comm_size(MPI_COMM_WORLD, &np); // Get no. of processes
   MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
 
-  sizeAB = N * (N + 1) / 2; //Only enough space for the nonzero portions of the matrices
-  sizeC = N * N; // All of C will be nonzero, in general!
+  sizeAB = (long) N * (N + 1) / 2; //Only enough space for the nonzero portions of the matrices
+  sizeC = (long) N * N; // All of C will be nonzero, in general!
   size = (int) ((N - 1) / np) + 1; // width of grouped rows or cols
-  length = (int) ((N * N - 1) / np) + 1;
   last_size = N - size * (np-1);
-  last_length = N * N - length * (np - 1);
+  if (last_size <= 0) {
+    if (rank == 0) printf("N = %d is too small for %d processes!\n", N, np);
+    MPI_Finalize();
+    exit(1);
+  }
 
-  // printf("last_length: %d\n", last_length);
   // printf("last_size: %d\n", last_size);
+  buffers_alloc(&buf, N, size);
+  partitions = (int *) malloc((long) np * size * sizeof(int));
+  psizes = (int *) malloc(4 * np * sizeof(int));
+  if (partitions == NULL || psizes == NULL) {
+    printf("Cannot allocate the partition table for %d processes!\n", np);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  counts = psizes + np;
+  displs = counts + np;
+  row_displs = displs + np;
+  make_partitions(N, np, size, partitions, psizes);
+  for (ip = 0; ip < np; ++ip) {
+    counts[ip] = group_len(partitions + (long) ip * size, psizes[ip]);
+    displs[ip] = (ip > 0) ? displs[ip-1] + counts[ip-1] : 0;
+    row_displs[ip] = ip * size;
+  }
+  rank_len = psizes[rank];
+  memcpy(buf.row_partition, partitions + (long) rank * size, rank_len * sizeof(int));
+  memcpy(buf.col_partition, buf.row_partition, rank_len * sizeof(int));
 
   if (rank == 0) {
     if (N == 4000) {
@@ -108,104 +229,110 @@ int main(int argc, char **argv) {
     A = (double *) calloc(sizeAB, sizeof(double));
     B = (double *) calloc(sizeAB, sizeof(double));
     C = (double *) calloc(sizeC, sizeof(double));
-
-    srand(12345); // Use a standard seed value for reproducibility
-    // This assumes A is stored by rows, and B is stored by columns. Other storage schemes are permitted
-    for (i=0; i<sizeAB; i++) A[i] = ((double) rand() / (double) RAND_MAX);
-    for (i=0; i<sizeAB; i++) B[i] = ((double) rand() / (double) RAND_MAX);
-  
-    i = 0;
-    j = N - 1;
-    for (ip = 0; ip < np; ++ip) {
-      k = 0; // partition cache pointer
-      while (i <= j) {
-        if (i <= j && k < size) {
-          partitions[ip][k] = i;
-          k += 1;
-          i += 1;
-        } else break;
-        if (i <= j && k < size) {
-          partitions[ip][k] = j;
-          k += 1;
-          j -= 1;
-        } else break;
-      }
-      psizes[ip] = k;
-      // printf("psizes: %d\n", psizes[ip]);
+    rowoff = (long *) malloc(N * sizeof(long));
+    if (A == NULL || B == NULL || C == NULL || rowoff == NULL) {
+      printf("Cannot allocate the %d x %d matrices!\n", N, N);
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
-    // copy assigned rows and cols to sending caches
+    // A and B are stored by rows (cols), but in the order the rows are dealt
+    // out, so the share of each rank is contiguous and scattered without a copy
     for (ip = 0; ip < np; ++ip) {
-      dst = 0;
-      for (k = 0; k < psizes[ip]; ++k) { // copy row by row & col by col
-        src = rc_start(partitions[ip][k]);
-        for (i = 0; i <= partitions[ip][k]; ++i) {
-          gA[dst + i] = A[src + i];
-          gB[dst + i] = B[src + i];
-        }
-        dst += partitions[ip][k] + 1;
+      rowoff[partitions[(long) ip * size]] = displs[ip];
+      for (k = 1; k < psizes[ip]; ++k) {
+        i = partitions[(long) ip * size + k - 1];
+        rowoff[partitions[(long) ip * size + k]] = rowoff[i] + i + 1;
       }
-      wct = MPI_Wtime();
-      MPI_Send(gA, dst, MPI_DOUBLE, ip, TAG_ROW, MPI_COMM_WORLD);
-      MPI_Send(gB, dst, MPI_DOUBLE, ip, TAG_COL, MPI_COMM_WORLD);
-      MPI_Send(partitions[ip], psizes[ip], MPI_DOUBLE, ip, TAG_PARTITION, MPI_COMM_WORLD);
-      cmt += MPI_Wtime() - wct;
     }
-    
+    srand(12345); // Use a standard seed value for reproducibility
+    // This assumes A is stored by rows, and B is stored by columns. Other storage schemes are permitted
+    for (i=0; i<N; i++) for (k=0; k<=i; k++) A[rowoff[i] + k] = ((double) rand() / (double) RAND_MAX);
+    for (i=0; i<N; i++) for (k=0; k<=i; k++) B[rowoff[i] + k] = ((double) rand() / (double) RAND_MAX);
+    free(rowoff);
   } // end of master process, part-I: task distribution
 
-  g_len = (rank < np-1) ? length : last_length;
-  p_len = (rank < np-1) ? size : last_size;
-  rank_len = p_len;
   wct = MPI_Wtime();
-  MPI_Recv(gA, g_len, MPI_DOUBLE, 0, TAG_ROW, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  MPI_Recv(gB, g_len, MPI_DOUBLE, 0, TAG_COL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  MPI_Recv(row_partition, p_len, MPI_DOUBLE, 0, TAG_PARTITION, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  memcpy(col_partition, row_partition, p_len * sizeof(double));
+  MPI_Scatterv(A, counts, displs, MPI_DOUBLE, buf.gA, counts[rank], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Scatterv(B, counts, displs, MPI_DOUBLE, buf.gB, counts[rank], MPI_DOUBLE, 0, MPI_COMM_WORLD);
   cmt += MPI_Wtime() - wct;
 
+  // Step j multiplies by the col group held in half j % 2. That group goes on
+  // to succ while the next one arrives from prev into the other half, both
+  // started before the multiply so the transfer hides behind it. Persistent
+  // requests are bound to a half and so always move cap values; the groups are
+  // balanced, so that is at most one row more than the actual length.
+  if (use_put) {
+    MPI_Win_create(buf.colbuf, 2L * buf.cap * sizeof(double), sizeof(double), MPI_INFO_NULL, MPI_COMM_WORLD, &win);
+    MPI_Win_create(buf.partbuf, 2 * size * sizeof(int), sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &pwin);
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, win);
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, pwin);
+  } else {
+    for (cur = 0; cur < 2; ++cur) {
+      buffers_select(&buf, cur);
+      MPI_Send_init(buf.gB, buf.cap, MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[cur][0]);
+      MPI_Send_init(buf.col_partition, size, MPI_INT, succ(rank, np), TAG_PARTITION, MPI_COMM_WORLD, &send_reqs[cur][1]);
+      MPI_Recv_init(buf.nB, buf.cap, MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[cur][0]);
+      MPI_Recv_init(buf.new_col_part, size, MPI_INT, prev(rank, np), TAG_PARTITION, MPI_COMM_WORLD, &recv_reqs[cur][1]);
+    }
+  }
+
   col = rank;
   for (j = 0; j < np; ++j) {
-    prev_gl = (col != 0) ? length : last_length;
-    prev_pl = (col != 0) ? size : last_size;
-    MPI_Irecv(nB, prev_gl, MPI_DOUBLE, prev(rank, np), TAG_COL, MPI_COMM_WORLD, &recv_reqs[rank][0]);
-    MPI_Irecv(new_col_part, prev_pl, MPI_DOUBLE, prev(rank, np), TAG_PARTITION, MPI_COMM_WORLD, &recv_reqs[rank][1]);
-
-    // doing work using old data, while receiving goes parallel
+    cur = j % 2;
+    buffers_select(&buf, j);
     p_len = (col < np-1) ? size : last_size;
-    cpt += dense_matmul(N, rank_len, p_len, row_partition, col_partition, gA, gB, ret);
+    if (j < np - 1) { // the last group is not needed by anyone
+      if (use_put) {
+        g_len = group_len(buf.col_partition, p_len);
+        MPI_Put(buf.gB, g_len, MPI_DOUBLE, succ(rank, np), (MPI_Aint) (1 - cur) * buf.cap, g_len, MPI_DOUBLE, win);
+        MPI_Put(buf.col_partition, p_len, MPI_INT, succ(rank, np), (1 - cur) * size, p_len, MPI_INT, pwin);
+      } else {
+        MPI_Startall(2, recv_reqs[cur]);
+        MPI_Startall(2, send_reqs[cur]);
+      }
+    }
 
-    g_len = (col < np-1) ? length : last_length;
-    // wait for sending to complete so that queue cache will not burst
-    // printf("wkr %d sending to %d\n", rank, succ(rank, np));
-    MPI_Isend(gB, g_len, MPI_DOUBLE, succ(rank, np), TAG_COL, MPI_COMM_WORLD, &send_reqs[rank][0]);
-    cmt += MPI_Wait_Timed(&send_reqs[rank][0]);
-    MPI_Isend(col_partition, p_len, MPI_DOUBLE, succ(rank, np), TAG_PARTITION, MPI_COMM_WORLD, &send_reqs[rank][1]);    
-    cmt += MPI_Wait_Timed(&send_reqs[rank][1]);
+    cpt += dense_matmul(N, rank_len, p_len, &buf);
 
+    if (j < np - 1) {
+      if (use_put) {
+        wct = MPI_Wtime();
+        MPI_Win_fence(0, win); // own puts done, and prev's put into the other half too
+        MPI_Win_fence(0, pwin);
+        cmt += MPI_Wtime() - wct;
+      } else {
+        cmt += MPI_Wait_Timed(&send_reqs[cur][0]);
+        cmt += MPI_Wait_Timed(&send_reqs[cur][1]);
+        cmt += MPI_Wait_Timed(&recv_reqs[cur][0]);
+        cmt += MPI_Wait_Timed(&recv_reqs[cur][1]);
+      }
+    }
     col = prev(col, np);
-    cmt += MPI_Wait_Timed(&recv_reqs[rank][0]);
-    memcpy(gB, nB, prev_gl * sizeof(double));
-    
-    cmt += MPI_Wait_Timed(&recv_reqs[rank][1]);
-    memcpy(col_partition, new_col_part, prev_pl * sizeof(double));
+  }
+
+  if (use_put) {
+    MPI_Win_free(&win);
+    MPI_Win_free(&pwin);
+  } else {
+    for (cur = 0; cur < 2; ++cur) {
+      for (k = 0; k < 2; ++k) {
+        MPI_Request_free(&send_reqs[cur][k]);
+        MPI_Request_free(&recv_reqs[cur][k]);
+      }
+    }
   }
   
-  // merely sending back data results is sufficient, cuz master knows orginal row partition
-  p_len = (rank < np-1) ? size : last_size;
-  MPI_Send(ret, p_len * N, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+  // merely sending back data results is sufficient, cuz every rank knows the row partition
+  MPI_Type_contiguous(N, MPI_DOUBLE, &row_type);
+  MPI_Type_commit(&row_type);
+  wct = MPI_Wtime();
+  MPI_Gatherv(buf.ret, rank_len, row_type, C, psizes, row_displs, row_type, 0, MPI_COMM_WORLD);
+  cmt += MPI_Wtime() - wct;
+  MPI_Type_free(&row_type);
 
   if (rank == 0) {
     wct = MPI_Wtime();
-    for (ip = 0; ip < np; ++ip) {
-      p_len = (ip < np-1) ? size : last_size;
-      MPI_Recv(ret, p_len * N, MPI_DOUBLE, ip, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      for (i = 0; i < p_len; ++i) {
-        dst = partitions[ip][i] * N;
-        src = i * N;
-        for (k = 0; k < N; ++k) { C[dst+k] = ret[src+k]; }
-      }
-    }
+    place_rows(C, N, partitions, buf.ret);
     cmt += MPI_Wtime() - wct;
 
     printf("%5d\t%9.4lf\t%9.4lf\n", N, cpt, cmt);
@@ -217,5 +344,8 @@ int main(int argc, char **argv) {
     free(C);
   }
 
+  free(partitions);
+  free(psizes);
+  buffers_free(&buf);
   MPI_Finalize();
 }
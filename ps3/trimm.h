@@ -0,0 +1,259 @@
+#ifndef PS3_TRIMM_H
+#define PS3_TRIMM_H
+
+/*
+  Blocked kernel for the packed triangular product used by every task of
+  Assignment #3: C(i,j) = sum over k <= min(i,j) of A(i,k) * B(k,j), with A
+  lower triangular stored by rows and B upper triangular stored by columns,
+  so row i of A and column j of B are both contiguous runs of i+1 and j+1
+  values starting at k = 0.
+
+  The caller describes the rows and columns it holds by a pointer to the
+  first value and the global index (row i, column j), which covers the whole
+  matrix in Task1, the row/column groups of Task2-3 and the paired
+  partitions of Task4 alike.
+
+  Loop structure is the usual GotoBLAS one: NC columns of B and KC values of
+  k are packed into a panel that stays in L2/L3, MC rows of A into a panel
+  that stays in L2, and an MR x NR register tile of C is accumulated from
+  them with FMAs. Packing writes zeros past the end of each row/column, which
+  are exactly the known-zero entries of the triangles, so a tile only has to
+  run to min(max row, max column) of its own rows and columns; tiles and
+  panels that lie wholly in the zero part are skipped.
+
+  The register tile follows the instruction set the compiler targets
+  (-xHost): 8x16 with AVX-512, 4x8 with AVX2+FMA, a plain C 4x4 otherwise.
+  The panel sizes can be overridden with -DTRIMM_KC=... etc.
+
+  trimm_packed_omp() spreads the rows over OpenMP threads. Pairing row i
+  with row N-1-i, as Task4 does for its ranks, evens out storage but not
+  work: row i costs about i*N - i*i/2 multiply-adds against the full B, so
+  pairs near the ends carry only 2/3 of a middle pair. Rows are instead cut
+  into chunks of equal exact cost, a few per thread, handed out
+  dynamically.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__AVX512F__)
+#define TRIMM_MR 8
+#define TRIMM_NR 16
+#elif defined(__AVX2__) && defined(__FMA__)
+#define TRIMM_MR 4
+#define TRIMM_NR 8
+#else
+#define TRIMM_MR 4
+#define TRIMM_NR 4
+#endif
+
+#ifndef TRIMM_KC
+#define TRIMM_KC 384
+#endif
+#ifndef TRIMM_MC
+#define TRIMM_MC 128
+#endif
+#ifndef TRIMM_NC
+#define TRIMM_NC 2048
+#endif
+#define TRIMM_MIN(a,b) (((a)<(b))?(a):(b))
+#define TRIMM_MAX(a,b) (((a)>(b))?(a):(b))
+
+// Packs values pc..pc+kc-1 of n rows (or columns) into tiles of width w:
+// tile t holds dst[(t*kc + k)*w + r] = src[t*w + r][pc + k], zero when that
+// entry is past the end of its row or the row does not exist.
+static inline void trimm_pack(int n, double **src, const int idx[], int pc, int kc, int w, double *dst) {
+  int t, r, k, len;
+  for (t = 0; t < n; t += w) {
+    for (r = 0; r < w; ++r) {
+      len = (t + r < n) ? idx[t + r] + 1 - pc : 0; // values left in this row
+      len = TRIMM_MAX(0, TRIMM_MIN(len, kc));
+      for (k = 0; k < len; ++k) dst[k*w + r] = src[t + r][pc + k];
+      for (k = len; k < kc; ++k) dst[k*w + r] = 0.0;
+    }
+    dst += kc * w;
+  }
+}
+
+// c[r*TRIMM_NR + s] = sum over k < kc of a[k*TRIMM_MR + r] * b[k*TRIMM_NR + s]
+static inline void trimm_micro(int kc, const double *a, const double *b, double *c) {
+  int k, r;
+#if defined(__AVX512F__)
+  __m512d acc[TRIMM_MR][2], b0, b1, ar;
+  for (r = 0; r < TRIMM_MR; ++r) acc[r][0] = acc[r][1] = _mm512_setzero_pd();
+  for (k = 0; k < kc; ++k) {
+    b0 = _mm512_load_pd(b + k*TRIMM_NR);
+    b1 = _mm512_load_pd(b + k*TRIMM_NR + 8);
+    for (r = 0; r < TRIMM_MR; ++r) {
+      ar = _mm512_set1_pd(a[k*TRIMM_MR + r]);
+      acc[r][0] = _mm512_fmadd_pd(ar, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_pd(ar, b1, acc[r][1]);
+    }
+  }
+  for (r = 0; r < TRIMM_MR; ++r) {
+    _mm512_store_pd(c + r*TRIMM_NR, acc[r][0]);
+    _mm512_store_pd(c + r*TRIMM_NR + 8, acc[r][1]);
+  }
+#elif defined(__AVX2__) && defined(__FMA__)
+  __m256d acc[TRIMM_MR][2], b0, b1, ar;
+  for (r = 0; r < TRIMM_MR; ++r) acc[r][0] = acc[r][1] = _mm256_setzero_pd();
+  for (k = 0; k < kc; ++k) {
+    b0 = _mm256_load_pd(b + k*TRIMM_NR);
+    b1 = _mm256_load_pd(b + k*TRIMM_NR + 4);
+    for (r = 0; r < TRIMM_MR; ++r) {
+      ar = _mm256_broadcast_sd(a + k*TRIMM_MR + r);
+      acc[r][0] = _mm256_fmadd_pd(ar, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_pd(ar, b1, acc[r][1]);
+    }
+  }
+  for (r = 0; r < TRIMM_MR; ++r) {
+    _mm256_store_pd(c + r*TRIMM_NR, acc[r][0]);
+    _mm256_store_pd(c + r*TRIMM_NR + 4, acc[r][1]);
+  }
+#else
+  int s;
+  double acc[TRIMM_MR][TRIMM_NR] = {{0.0}};
+  for (k = 0; k < kc; ++k)
+    for (r = 0; r < TRIMM_MR; ++r)
+      for (s = 0; s < TRIMM_NR; ++s) acc[r][s] += a[k*TRIMM_MR + r] * b[k*TRIMM_NR + s];
+  memcpy(c, acc, sizeof(acc));
+#endif
+}
+
+/*
+  C[i*ldc + j] = row i . column j for the nr rows and nc columns given.
+  rows[i] points at the packed row of A with global index rowk[i] (so it
+  holds rowk[i]+1 values), cols[j] at the packed column of B with global
+  index colk[j]. Any order of rows and columns is fine.
+*/
+static inline void trimm_packed(int nr, double **rows, const int rowk[],
+                                int nc, double **cols, const int colk[],
+                                double *C, int ldc) {
+  int i, j, ic, jc, pc, ir, jr, mc, ncb, kc, kmax, maxk, r, s, ktile;
+  int rmax[TRIMM_MC / TRIMM_MR], cmax[TRIMM_NC / TRIMM_NR];
+  double *Ap, *Bp, *tile;
+
+  for (i = 0; i < nr; ++i)
+    for (j = 0; j < nc; ++j) C[(long) i*ldc + j] = 0.0;
+  if (nr == 0 || nc == 0) return;
+
+  Ap = (double *) _mm_malloc(TRIMM_MC * TRIMM_KC * sizeof(double), 64);
+  Bp = (double *) _mm_malloc(TRIMM_KC * TRIMM_NC * sizeof(double), 64);
+  tile = (double *) _mm_malloc(TRIMM_MR * TRIMM_NR * sizeof(double), 64);
+
+  maxk = 0;
+  for (i = 0; i < nr; ++i) maxk = TRIMM_MAX(maxk, rowk[i]);
+
+  for (jc = 0; jc < nc; jc += TRIMM_NC) {
+    ncb = TRIMM_MIN(TRIMM_NC, nc - jc);
+    // longest column in each NR-wide tile of this panel
+    for (jr = 0; jr < ncb; jr += TRIMM_NR) {
+      cmax[jr / TRIMM_NR] = -1;
+      for (s = jr; s < TRIMM_MIN(jr + TRIMM_NR, ncb); ++s) cmax[jr / TRIMM_NR] = TRIMM_MAX(cmax[jr / TRIMM_NR], colk[jc + s]);
+    }
+    for (pc = 0; pc <= maxk; pc += TRIMM_KC) {
+      kc = TRIMM_KC;
+      trimm_pack(ncb, cols + jc, colk + jc, pc, kc, TRIMM_NR, Bp);
+
+      for (ic = 0; ic < nr; ic += TRIMM_MC) {
+        mc = TRIMM_MIN(TRIMM_MC, nr - ic);
+        for (ir = 0; ir < mc; ir += TRIMM_MR) {
+          rmax[ir / TRIMM_MR] = -1;
+          for (r = ir; r < TRIMM_MIN(ir + TRIMM_MR, mc); ++r) rmax[ir / TRIMM_MR] = TRIMM_MAX(rmax[ir / TRIMM_MR], rowk[ic + r]);
+        }
+        kmax = -1;
+        for (ir = 0; ir < mc; ir += TRIMM_MR) kmax = TRIMM_MAX(kmax, rmax[ir / TRIMM_MR]);
+        if (kmax < pc) continue; // whole row panel is zero in this k range
+        trimm_pack(mc, rows + ic, rowk + ic, pc, kc, TRIMM_MR, Ap);
+
+        for (jr = 0; jr < ncb; jr += TRIMM_NR) {
+          for (ir = 0; ir < mc; ir += TRIMM_MR) {
+            // entries beyond min(longest row, longest column) are all zero
+            ktile = TRIMM_MIN(rmax[ir / TRIMM_MR], cmax[jr / TRIMM_NR]) + 1 - pc;
+            if (ktile <= 0) continue;
+            ktile = TRIMM_MIN(ktile, kc);
+            trimm_micro(ktile, Ap + ir * kc, Bp + jr * kc, tile);
+            for (r = 0; r < TRIMM_MIN(TRIMM_MR, mc - ir); ++r)
+              for (s = 0; s < TRIMM_MIN(TRIMM_NR, ncb - jr); ++s)
+                C[(long) (ic + ir + r)*ldc + jc + jr + s] += tile[r*TRIMM_NR + s];
+          }
+        }
+      }
+    }
+  }
+
+  _mm_free(Ap);
+  _mm_free(Bp);
+  _mm_free(tile);
+}
+
+static inline int trimm_cmp_int(const void *a, const void *b) {
+  return *(const int *) a - *(const int *) b;
+}
+
+// Same result as trimm_packed, computed by all OpenMP threads.
+static inline void trimm_packed_omp(int nr, double **rows, const int rowk[],
+                                    int nc, double **cols, const int colk[],
+                                    double *C, int ldc) {
+  int i, c, lo, hi, m, nt = 1, nchunk;
+  int *sk, *bounds;
+  double *cost, *below, total;
+
+#ifdef _OPENMP
+  nt = omp_get_max_threads();
+#endif
+  if (nt == 1 || nr < 2 * TRIMM_MR) {
+    trimm_packed(nr, rows, rowk, nc, cols, colk, C, ldc);
+    return;
+  }
+
+  // cost of row i = sum over columns of min(rowk[i], colk[j]) + 1, from the
+  // sorted column indices and their prefix sums
+  sk = (int *) malloc(nc * sizeof(int));
+  below = (double *) malloc((nc + 1) * sizeof(double));
+  cost = (double *) malloc((nr + 1) * sizeof(double));
+  memcpy(sk, colk, nc * sizeof(int));
+  qsort(sk, nc, sizeof(int), trimm_cmp_int);
+  below[0] = 0.0;
+  for (m = 0; m < nc; ++m) below[m + 1] = below[m] + sk[m] + 1;
+  cost[0] = 0.0;
+  for (i = 0; i < nr; ++i) {
+    lo = 0;
+    hi = nc; // first column longer than row i
+    while (lo < hi) {
+      m = (lo + hi) / 2;
+      if (sk[m] <= rowk[i]) lo = m + 1; else hi = m;
+    }
+    cost[i + 1] = cost[i] + below[lo] + (double) (nc - lo) * (rowk[i] + 1);
+  }
+  total = cost[nr];
+
+  // chunk boundaries on MR-row tiles, so no register tile is split
+  nchunk = 4 * nt;
+  bounds = (int *) malloc((nchunk + 1) * sizeof(int));
+  bounds[0] = 0;
+  i = 0;
+  for (c = 1; c < nchunk; ++c) {
+    while (i < nr && cost[i] < total * c / nchunk) i++;
+    bounds[c] = TRIMM_MAX(bounds[c - 1], i / TRIMM_MR * TRIMM_MR);
+  }
+  bounds[nchunk] = nr;
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (c = 0; c < nchunk; ++c) {
+    if (bounds[c + 1] > bounds[c])
+      trimm_packed(bounds[c + 1] - bounds[c], rows + bounds[c], rowk + bounds[c],
+                   nc, cols, colk, C + (long) bounds[c] * ldc, ldc);
+  }
+
+  free(sk);
+  free(below);
+  free(cost);
+  free(bounds);
+}
+
+#endif
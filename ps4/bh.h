@@ -0,0 +1,272 @@
+#ifndef PS4_BH_H
+#define PS4_BH_H
+
+/*
+  Barnes-Hut octree for the runs without a cutoff. Bodies are sorted by the
+  Morton code of their position within the bounding cube, so every node of
+  the octree is a contiguous range of that order: a node's children are
+  found by binary search on the next 3 bits instead of by inserting bodies
+  one at a time. Levels where all bodies fall into the same octant are
+  skipped, hence every inner node has at least 2 children and the tree
+  never needs more than 2N nodes, which live in one arena kept from step to
+  step.
+
+  Big subtrees are built as OpenMP tasks, each taking its children's slots
+  from the arena with an atomic add. A node is accepted as a single point
+  mass at its center of mass when its side s and the distance d from the
+  body satisfy s < theta * d; theta = 0 opens everything, i.e. it is the
+  direct sum in a different order.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define BH_LEAF 8  // bodies a leaf may hold
+#define BH_LEVELS 21  // bits of a coordinate in the Morton code
+#define BH_TASK 4096  // smallest subtree built as a task of its own
+#define BH_STACK (8 * BH_LEVELS + 8)
+
+typedef struct bh_key_t {
+	uint64_t key;
+	int body;
+} BHKey;
+
+typedef struct bh_node_t {
+	double com[3];  // center of mass
+	double mass;
+	double size;  // side of the node's cube
+	int first, count;  // bodies in Morton order
+	int child, n_child;  // first child in the arena, -1 for a leaf
+} BHNode;
+
+typedef struct bh_tree_t {
+	int n, cap;  // bodies, and bodies the arrays can hold
+	BHKey *keys;
+	double *x, *m;  // positions (3 per body) and masses in Morton order
+	BHNode *nodes;  // the arena; node 0 is the root
+	int n_node;
+} BHTree;
+
+static inline void bh_init(BHTree *t) {
+	memset(t, 0, sizeof(BHTree));
+}
+
+static inline void bh_free(BHTree *t) {
+	free(t->keys);
+	free(t->x);
+	free(t->m);
+	free(t->nodes);
+	bh_init(t);
+}
+
+static inline void bh_reserve(BHTree *t, int n) {
+	if (n <= t->cap) return;
+	t->cap = n;
+	t->keys = (BHKey *) realloc(t->keys, (size_t) n * sizeof(BHKey));
+	t->x = (double *) realloc(t->x, 3 * (size_t) n * sizeof(double));
+	t->m = (double *) realloc(t->m, (size_t) n * sizeof(double));
+	t->nodes = (BHNode *) realloc(t->nodes, (2 * (size_t) n + 1) * sizeof(BHNode));
+	if (t->keys == NULL || t->x == NULL || t->m == NULL || t->nodes == NULL) {
+		printf("Cannot allocate a Barnes-Hut tree of %d bodies!\n", n);
+		exit(1);
+	}
+}
+
+// spreads the low 21 bits of v so that there are 2 zeros between any two
+static inline uint64_t bh_spread(uint64_t v) {
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v << 8) & 0x100f00f00f00f00fULL;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2) & 0x1249249249249249ULL;
+	return v;
+}
+
+static int bh_cmp_key(const void *a, const void *b) {
+	const BHKey *p = (const BHKey *) a, *q = (const BHKey *) b;
+	if (p->key != q->key) return p->key < q->key ? -1 : 1;
+	return p->body - q->body;
+}
+
+// first body in [lo, hi) whose key is at least key
+static inline int bh_lower(const BHKey *keys, int lo, int hi, uint64_t key) {
+	int mid;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (keys[mid].key < key) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+static void bh_build_node(BHTree *t, int node, int first, int count, int level, double size) {
+	BHNode *nd = &t->nodes[node];
+	int bounds[9], o, c, k, i, shift, n_child, base;
+	uint64_t prefix;
+
+	for (;;) {
+		if (count <= BH_LEAF || level == BH_LEVELS) {
+			nd->child = -1;
+			nd->n_child = 0;
+			break;
+		}
+		// the bits above shift are the same for every body of the node
+		shift = 3 * (BH_LEVELS - 1 - level);
+		prefix = t->keys[first].key >> (shift + 3) << (shift + 3);
+		bounds[0] = first;
+		for (o = 1; o < 8; ++ o) bounds[o] = bh_lower(t->keys, bounds[o - 1], first + count, prefix | (uint64_t) o << shift);
+		bounds[8] = first + count;
+		n_child = 0;
+		for (o = 0; o < 8; ++ o) n_child += bounds[o + 1] > bounds[o];
+		size *= .5;
+		level += 1;
+		if (n_child == 1) continue;  // one level down, still the same node
+
+		#pragma omp atomic capture
+		{ base = t->n_node; t->n_node += n_child; }
+		nd->child = base;
+		nd->n_child = n_child;
+		c = 0;
+		for (o = 0; o < 8; ++ o) {
+			if (bounds[o + 1] == bounds[o]) continue;
+			#pragma omp task if (bounds[o + 1] - bounds[o] >= BH_TASK)
+			bh_build_node(t, base + c, bounds[o], bounds[o + 1] - bounds[o], level, size);
+			c += 1;
+		}
+		#pragma omp taskwait
+		break;
+	}
+
+	nd->first = first;
+	nd->count = count;
+	nd->size = size;
+	nd->mass = .0;
+	nd->com[0] = nd->com[1] = nd->com[2] = .0;
+	if (nd->child < 0) {
+		for (i = first; i < first + count; ++ i) {
+			nd->mass += t->m[i];
+			for (k = 0; k < 3; ++ k) nd->com[k] += t->m[i] * t->x[3 * i + k];
+		}
+	} else {
+		for (c = nd->child; c < nd->child + nd->n_child; ++ c) {
+			nd->mass += t->nodes[c].mass;
+			for (k = 0; k < 3; ++ k) nd->com[k] += t->nodes[c].mass * t->nodes[c].com[k];
+		}
+	}
+	if (nd->mass > .0) for (k = 0; k < 3; ++ k) nd->com[k] /= nd->mass;
+}
+
+// Builds the tree over n bodies at x[3 * i] with masses m[i]; opens its
+// own parallel regions, so call it from serial code
+static inline void bh_build(BHTree *t, int n, const double x[], const double m[]) {
+	double lo[3], hi[3], size, scale;
+	int i, k, b, start[65];
+	BHKey *tmp;
+
+	bh_reserve(t, n);
+	t->n = n;
+	t->n_node = 1;
+	if (n == 0) {
+		memset(t->nodes, 0, sizeof(BHNode));
+		t->nodes[0].child = -1;
+		return;
+	}
+
+	for (k = 0; k < 3; ++ k) lo[k] = hi[k] = x[k];
+	for (i = 1; i < n; ++ i) {
+		for (k = 0; k < 3; ++ k) {
+			if (x[3 * i + k] < lo[k]) lo[k] = x[3 * i + k];
+			if (x[3 * i + k] > hi[k]) hi[k] = x[3 * i + k];
+		}
+	}
+	size = hi[0] - lo[0];
+	for (k = 1; k < 3; ++ k) if (hi[k] - lo[k] > size) size = hi[k] - lo[k];
+	if (size <= .0) size = 1.0;
+	size *= 1.0 + 1e-9;  // keeps the top corner inside
+	scale = (double) (1 << BH_LEVELS) / size;
+
+	#pragma omp parallel for private(k)
+	for (i = 0; i < n; ++ i) {
+		uint64_t c[3];
+		for (k = 0; k < 3; ++ k) {
+			double u = (x[3 * i + k] - lo[k]) * scale;
+			c[k] = u < .0 ? 0 : u >= (1 << BH_LEVELS) ? (1 << BH_LEVELS) - 1 : (uint64_t) u;
+		}
+		t->keys[i].key = bh_spread(c[0]) | bh_spread(c[1]) << 1 | bh_spread(c[2]) << 2;
+		t->keys[i].body = i;
+	}
+
+	// split on the top 6 bits, then sort the 64 buckets side by side
+	tmp = (BHKey *) malloc((size_t) n * sizeof(BHKey));
+	if (tmp == NULL) {
+		printf("Cannot allocate a Barnes-Hut tree of %d bodies!\n", n);
+		exit(1);
+	}
+	memset(start, 0, sizeof(start));
+	for (i = 0; i < n; ++ i) start[(t->keys[i].key >> (3 * BH_LEVELS - 6)) + 1] += 1;
+	for (b = 0; b < 64; ++ b) start[b + 1] += start[b];
+	for (i = 0; i < n; ++ i) tmp[start[t->keys[i].key >> (3 * BH_LEVELS - 6)] ++] = t->keys[i];
+	memcpy(t->keys, tmp, (size_t) n * sizeof(BHKey));
+	free(tmp);
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (b = 0; b < 64; ++ b) {
+		int b0 = b ? start[b - 1] : 0;
+		qsort(t->keys + b0, start[b] - b0, sizeof(BHKey), bh_cmp_key);
+	}
+
+	#pragma omp parallel for private(k)
+	for (i = 0; i < n; ++ i) {
+		for (k = 0; k < 3; ++ k) t->x[3 * i + k] = x[3 * t->keys[i].body + k];
+		t->m[i] = m[t->keys[i].body];
+	}
+
+	#pragma omp parallel
+	#pragma omp single
+	bh_build_node(t, 0, 0, n, 0, size);
+}
+
+// Adds the force on the p-th body in Morton order to F[], with the same
+// pair formula as compute_force_as_vector()
+static inline void bh_force(const BHTree *t, int p, double theta, double F[3]) {
+	int stack[BH_STACK], top = 0, i, c;
+	const double *xp = t->x + 3 * p;
+	const double mp = t->m[p];
+	const BHNode *nd;
+	double dx, dy, dz, r2, tmp;
+
+	if (t->n == 0) return;
+	stack[top ++] = 0;
+	while (top > 0) {
+		nd = &t->nodes[stack[-- top]];
+		dx = nd->com[0] - xp[0];
+		dy = nd->com[1] - xp[1];
+		dz = nd->com[2] - xp[2];
+		r2 = dx * dx + dy * dy + dz * dz;
+		if ((p < nd->first || p >= nd->first + nd->count) && nd->size * nd->size < theta * theta * r2) {
+			tmp = (G * mp * nd->mass) / (r2 * sqrt(r2));
+			F[0] += tmp * dx;
+			F[1] += tmp * dy;
+			F[2] += tmp * dz;
+		} else if (nd->child < 0) {
+			for (i = nd->first; i < nd->first + nd->count; ++ i) {
+				if (i == p) continue;
+				dx = t->x[3 * i] - xp[0];
+				dy = t->x[3 * i + 1] - xp[1];
+				dz = t->x[3 * i + 2] - xp[2];
+				r2 = dx * dx + dy * dy + dz * dz;
+				tmp = (G * mp * t->m[i]) / (r2 * sqrt(r2));
+				F[0] += tmp * dx;
+				F[1] += tmp * dy;
+				F[2] += tmp * dz;
+			}
+		} else {
+			for (c = nd->child; c < nd->child + nd->n_child; ++ c) stack[top ++] = c;
+		}
+	}
+}
+
+#endif
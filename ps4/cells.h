@@ -0,0 +1,227 @@
+#ifndef PS4_CELLS_H
+#define PS4_CELLS_H
+
+/*
+  Uniform-grid cell list for the 5 DU cutoff force loop of serial.c and
+  fserial.c. Points are binned into cubic cells of width at least
+  CUTOFF + skin, and every cell holding a query point keeps the sorted
+  indices of all points in its 3x3x3 neighborhood. A body then only looks at those
+  candidates, in the same index order as the N x N loop, so the sums of F
+  come out bit for bit the same.
+
+  The bodies are updated in place, so positions drift away from the ones
+  the grid was built from. The caller reports every move; once some point
+  has moved more than half the skin the list is stale. Until then two
+  points within CUTOFF of each other were within CUTOFF + skin when
+  binned, i.e. in adjacent cells, so no pair is missed. Where bodies move
+  while the forces are summed, the list is built once at the start of the
+  step, with a skin sized by cells_skin() from how far the bodies moved in
+  the step before; should it still go stale within the step, the rest of
+  that step uses the direct loop. So does a step whose list would not
+  prune enough pairs to pay for itself (cells_pays()).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef CELL_SKIN
+#define CELL_SKIN 1.0
+#endif
+#ifndef CELL_FILL
+#define CELL_FILL 0.5  // largest share of all pairs the candidates may cover and still pay off
+#endif
+
+typedef struct cell_list_t {
+	int cap;  // points the arrays can hold
+	int n;  // points binned by the last build
+	int n_query;  // of which the first n_query have candidates
+	double n_pair;  // candidates of all query points together
+	double *x0;  // position of each point when binned, 3 per point
+	int *cell;  // cell of each point
+	int n_cell, cell_cap;
+	int *count;  // points per cell
+	int *fill;  // candidates of each cell written so far
+	int *cand_first;  // offset of each cell's neighborhood in cand, n_cell + 1 entries
+	int *cand;  // candidates of each cell, ascending
+	int cand_cap;
+	double skin;  // of the last build
+	double max_moved2;  // largest squared displacement since the build
+} CellList;
+
+static void cells_die(int n) {
+	printf("Cannot allocate a cell list for %d bodies!\n", n);
+	exit(1);
+}
+
+static inline void cells_init(CellList *cl) {
+	memset(cl, 0, sizeof(CellList));
+}
+
+static inline void cells_free(CellList *cl) {
+	free(cl->x0);
+	free(cl->cell);
+	free(cl->count);
+	free(cl->fill);
+	free(cl->cand_first);
+	free(cl->cand);
+	cells_init(cl);
+}
+
+// make room for n points; keeps what has been set so far
+static inline void cells_reserve(CellList *cl, int n) {
+	if (n <= cl->cap) return;
+	cl->cap = n + n / 2;
+	cl->x0 = (double *) realloc(cl->x0, 3 * (size_t) cl->cap * sizeof(double));
+	cl->cell = (int *) realloc(cl->cell, cl->cap * sizeof(int));
+	if (cl->x0 == NULL || cl->cell == NULL) cells_die(n);
+}
+
+// position of point i for the next build
+static inline void cells_set(CellList *cl, int i, const double x[3]) {
+	cells_reserve(cl, i + 1);
+	memcpy(cl->x0 + 3 * i, x, 3 * sizeof(double));
+}
+
+static inline int cells_inside(const int dims[3], int x, int y, int z) {
+	return x >= 0 && y >= 0 && z >= 0 && x < dims[0] && y < dims[1] && z < dims[2];
+}
+
+// bins points 0 .. n-1 as last set with cells_set(); candidates are only
+// kept for points 0 .. n_query-1
+static inline void cells_build(CellList *cl, int n, int n_query, double skin) {
+	double lo[3], hi[3], w, limit, cells_d;
+	int dims[3], i, k, c, cx, cy, cz, dx, dy, dz, len;
+	long n_cell;
+
+	cl->n = n;
+	cl->n_query = n_query;
+	cl->n_pair = .0;
+	cl->skin = skin;
+	cl->max_moved2 = .0;
+	if (n == 0) {
+		cl->n_cell = 0;
+		return;
+	}
+	for (k = 0; k < 3; ++ k) lo[k] = hi[k] = cl->x0[k];
+	for (i = 1; i < n; ++ i) {
+		for (k = 0; k < 3; ++ k) {
+			if (cl->x0[3 * i + k] < lo[k]) lo[k] = cl->x0[3 * i + k];
+			if (cl->x0[3 * i + k] > hi[k]) hi[k] = cl->x0[3 * i + k];
+		}
+	}
+	// a few escaping bodies must not blow up the grid: widen the cells
+	// until there are at most about 2 per point. Counts are taken in double
+	// and no axis gets more than that many cells, so the casts cannot overflow
+	limit = 2.0 * n + 27;
+	w = sqrt(CUTOFF_SQR) + skin;
+	for (k = 0; k < 3; ++ k) {
+		if ((hi[k] - lo[k]) / w + 1 > limit) w = (hi[k] - lo[k]) / (limit - 1);
+	}
+	for (;;) {
+		cells_d = 1.0;
+		for (k = 0; k < 3; ++ k) cells_d *= floor((hi[k] - lo[k]) / w) + 1;
+		if (cells_d <= limit) break;
+		w *= 1.25;
+	}
+	n_cell = 1;
+	for (k = 0; k < 3; ++ k) {
+		dims[k] = (int) ((hi[k] - lo[k]) / w) + 1;
+		n_cell *= dims[k];
+	}
+
+	cl->n_cell = (int) n_cell;
+	if (cl->n_cell + 1 > cl->cell_cap) {
+		cl->cell_cap = cl->n_cell + 1;
+		cl->count = (int *) realloc(cl->count, cl->cell_cap * sizeof(int));
+		cl->fill = (int *) realloc(cl->fill, cl->cell_cap * sizeof(int));
+		cl->cand_first = (int *) realloc(cl->cand_first, cl->cell_cap * sizeof(int));
+		if (cl->count == NULL || cl->fill == NULL || cl->cand_first == NULL) cells_die(n);
+	}
+	memset(cl->count, 0, cl->n_cell * sizeof(int));
+	for (i = 0; i < n; ++ i) {
+		c = 0;
+		for (k = 2; k >= 0; -- k) {
+			int ix = (int) ((cl->x0[3 * i + k] - lo[k]) / w);
+			if (ix >= dims[k]) ix = dims[k] - 1;
+			c = c * dims[k] + ix;
+		}
+		cl->cell[i] = c;
+		cl->count[c] += 1;
+	}
+
+	// neighborhoods of the cells holding a query point: sizes first, then
+	// every point is appended to each of them around it, in index order, so
+	// the lists come out sorted
+	memset(cl->cand_first, 0, (cl->n_cell + 1) * sizeof(int));
+	for (i = 0; i < n_query; ++ i) cl->cand_first[cl->cell[i]] = 1;
+	len = 0;
+	for (c = 0; c < cl->n_cell; ++ c) {
+		int want = cl->cand_first[c];
+		cl->cand_first[c] = len;
+		if (!want) continue;
+		cx = c % dims[0];
+		cy = (c / dims[0]) % dims[1];
+		cz = c / (dims[0] * dims[1]);
+		for (dz = -1; dz <= 1; ++ dz) for (dy = -1; dy <= 1; ++ dy) for (dx = -1; dx <= 1; ++ dx) {
+			if (cells_inside(dims, cx + dx, cy + dy, cz + dz))
+				len += cl->count[((cz + dz) * dims[1] + cy + dy) * dims[0] + cx + dx];
+		}
+		cl->fill[c] = 0;
+	}
+	cl->cand_first[cl->n_cell] = len;
+	for (i = 0; i < n_query; ++ i) cl->n_pair += cl->cand_first[cl->cell[i] + 1] - cl->cand_first[cl->cell[i]];
+	if (len > cl->cand_cap) {
+		cl->cand_cap = len + len / 2;
+		cl->cand = (int *) realloc(cl->cand, cl->cand_cap * sizeof(int));
+		if (cl->cand == NULL) cells_die(n);
+	}
+	for (i = 0; i < n; ++ i) {
+		c = cl->cell[i];
+		cx = c % dims[0];
+		cy = (c / dims[0]) % dims[1];
+		cz = c / (dims[0] * dims[1]);
+		for (dz = -1; dz <= 1; ++ dz) for (dy = -1; dy <= 1; ++ dy) for (dx = -1; dx <= 1; ++ dx) {
+			int nc = ((cz + dz) * dims[1] + cy + dy) * dims[0] + cx + dx;
+			if (!cells_inside(dims, cx + dx, cy + dy, cz + dz)) continue;
+			if (cl->cand_first[nc] == cl->cand_first[nc + 1]) continue;  // nobody asks about it
+			cl->cand[cl->cand_first[nc] + cl->fill[nc]] = i;
+			cl->fill[nc] += 1;
+		}
+	}
+}
+
+// candidates for point i, which includes i itself
+static inline const int *cells_candidates(const CellList *cl, int i, int *n_cand) {
+	int c = cl->cell[i];
+	*n_cand = cl->cand_first[c + 1] - cl->cand_first[c];
+	return cl->cand + cl->cand_first[c];
+}
+
+// point i is now at x
+static inline void cells_moved(CellList *cl, int i, const double x[3]) {
+	const double *p = cl->x0 + 3 * i;
+	double d2 = (x[0] - p[0]) * (x[0] - p[0]) + (x[1] - p[1]) * (x[1] - p[1]) + (x[2] - p[2]) * (x[2] - p[2]);
+	if (d2 > cl->max_moved2) cl->max_moved2 = d2;
+}
+
+static inline int cells_stale(const CellList *cl) {
+	return cl->max_moved2 > 0.25 * cl->skin * cl->skin;
+}
+
+// whether the candidates leave out enough pairs to beat the direct loop;
+// in a dense cluster every neighborhood holds nearly all of the bodies
+static inline int cells_pays(const CellList *cl) {
+	return cl->n_pair <= CELL_FILL * cl->n_query * (double) cl->n;
+}
+
+// Skin for a build that has to last a whole step, when no body moved
+// further than move in the last one: some room to spare, never below
+// CELL_SKIN. A body that outruns it anyway makes the list stale mid-step,
+// and the caller finishes the step with the direct loop.
+static inline double cells_skin(double move) {
+	return 2.5 * move > CELL_SKIN ? 2.5 * move : CELL_SKIN;
+}
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef PS4_DECOMP_H
+#define PS4_DECOMP_H
+
+/*
+  Recursive coordinate bisection of space over any number of ranks. The
+  ranks [r0, r1) of a node are split into [r0, rm) and [rm, r1) with
+  rm = r0 + (r1 - r0) / 2, by a plane across the longest extent of the
+  node's bodies, placed so that each side gets a share of the body weight
+  proportional to its ranks. Every boundary rm = 1 .. np-1 is used by
+  exactly one node, so the whole tree is just axis[rm] and cut[rm].
+
+  The outermost boxes are unbounded, so every point in space has an owner,
+  and a rank only needs the bodies of the ranks whose boxes come within the
+  cutoff of its own.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct domain_t {
+	int np;
+	int *axis;  // axis[rm] and cut[rm]: points with x[axis] < cut go to ranks below rm
+	double *cut;
+	double *lo, *hi;  // box of rank r is [lo, hi) at N_DIM * r
+	int n_nbr;  // ranks whose boxes are within cutoff of ours
+	int *nbr;
+	int *nbr_of;  // position of each rank in nbr, -1 if it is none
+} Domain;
+
+static inline void domain_init(Domain *d, int np) {
+	d->np = np;
+	d->n_nbr = 0;
+	d->axis = (int *) calloc(np, sizeof(int));
+	d->cut = (double *) calloc(np, sizeof(double));
+	d->lo = (double *) malloc(N_DIM * np * sizeof(double));
+	d->hi = (double *) malloc(N_DIM * np * sizeof(double));
+	d->nbr = (int *) malloc(np * sizeof(int));
+	d->nbr_of = (int *) malloc(np * sizeof(int));
+	if (d->axis == NULL || d->cut == NULL || d->lo == NULL || d->hi == NULL || d->nbr == NULL || d->nbr_of == NULL) {
+		printf("Cannot allocate the decomposition of %d ranks!\n", np);
+		exit(1);
+	}
+}
+
+static inline void domain_free(Domain *d) {
+	free(d->axis);
+	free(d->cut);
+	free(d->lo);
+	free(d->hi);
+	free(d->nbr);
+	free(d->nbr_of);
+}
+
+static inline int domain_owner(const Domain *d, const double x[]) {
+	int r0 = 0, r1 = d->np, rm;
+	while (r1 - r0 > 1) {
+		rm = r0 + (r1 - r0) / 2;
+		if (x[d->axis[rm]] < d->cut[rm]) r1 = rm;
+		else r0 = rm;
+	}
+	return r0;
+}
+
+// squared distance from x to the box of rank r
+static inline double domain_dist2(const Domain *d, int r, const double x[]) {
+	double s = .0, e;
+	int k;
+	for (k = 0; k < N_DIM; ++ k) {
+		e = .0;
+		if (x[k] < d->lo[N_DIM * r + k]) e = d->lo[N_DIM * r + k] - x[k];
+		else if (x[k] > d->hi[N_DIM * r + k]) e = x[k] - d->hi[N_DIM * r + k];
+		s += e * e;
+	}
+	return s;
+}
+
+static const double *bisect_x;  // qsort has no context argument
+static int bisect_k;
+
+static int bisect_cmp(const void *a, const void *b) {
+	int i = *(const int *) a, j = *(const int *) b;
+	double xi = bisect_x[N_DIM * i + bisect_k], xj = bisect_x[N_DIM * j + bisect_k];
+	if (xi != xj) return xi < xj ? -1 : 1;
+	return i - j;
+}
+
+// builds the tree for ranks [r0, r1) over the m points idx[] of x (N_DIM
+// per point) with weights w; reorders idx
+static inline void domain_bisect(Domain *d, const double x[], const double w[], int idx[], int m, int r0, int r1) {
+	double lo[N_DIM], hi[N_DIM], total = .0, target, part, best;
+	int rm, i, k, ax, split, left;
+
+	if (r1 - r0 < 2) return;
+	rm = r0 + (r1 - r0) / 2;
+	ax = 0;
+	if (m > 0) {
+		for (k = 0; k < N_DIM; ++ k) lo[k] = hi[k] = x[N_DIM * idx[0] + k];
+		for (i = 1; i < m; ++ i) {
+			for (k = 0; k < N_DIM; ++ k) {
+				if (x[N_DIM * idx[i] + k] < lo[k]) lo[k] = x[N_DIM * idx[i] + k];
+				if (x[N_DIM * idx[i] + k] > hi[k]) hi[k] = x[N_DIM * idx[i] + k];
+			}
+		}
+		for (k = 1; k < N_DIM; ++ k)
+			if (hi[k] - lo[k] > hi[ax] - lo[ax]) ax = k;
+	}
+	d->axis[rm] = ax;
+	if (m < 2) {
+		d->cut[rm] = m ? x[N_DIM * idx[0] + ax] : .0;
+		left = 0;
+	} else {
+		bisect_x = x;
+		bisect_k = ax;
+		qsort(idx, m, sizeof(int), bisect_cmp);
+		for (i = 0; i < m; ++ i) total += w[idx[i]];
+		target = total * (rm - r0) / (r1 - r0);
+		// first split point whose prefix weight is closest to the target,
+		// keeping at least one point on each side
+		split = 1;
+		part = w[idx[0]];
+		best = fabs(part - target);
+		for (i = 1; i < m - 1; ++ i) {
+			part += w[idx[i]];
+			if (fabs(part - target) < best) {
+				best = fabs(part - target);
+				split = i + 1;
+			}
+		}
+		d->cut[rm] = 0.5 * (x[N_DIM * idx[split - 1] + ax] + x[N_DIM * idx[split] + ax]);
+		// points on the cut belong to the upper half, as in domain_owner()
+		for (left = 0; left < m && x[N_DIM * idx[left] + ax] < d->cut[rm]; ++ left);
+	}
+	domain_bisect(d, x, w, idx, left, r0, rm);
+	domain_bisect(d, x, w, idx + left, m - left, rm, r1);
+}
+
+// recomputes every box from the tree, and the neighbors of rank self
+static inline void domain_finish(Domain *d, int self, double cutoff_sqr) {
+	int r, r0, r1, rm, k;
+	double s, e;
+
+	for (r = 0; r < d->np; ++ r) {
+		for (k = 0; k < N_DIM; ++ k) {
+			d->lo[N_DIM * r + k] = -HUGE_VAL;
+			d->hi[N_DIM * r + k] = HUGE_VAL;
+		}
+		r0 = 0;
+		r1 = d->np;
+		while (r1 - r0 > 1) {
+			rm = r0 + (r1 - r0) / 2;
+			if (r < rm) {
+				if (d->cut[rm] < d->hi[N_DIM * r + d->axis[rm]]) d->hi[N_DIM * r + d->axis[rm]] = d->cut[rm];
+				r1 = rm;
+			} else {
+				if (d->cut[rm] > d->lo[N_DIM * r + d->axis[rm]]) d->lo[N_DIM * r + d->axis[rm]] = d->cut[rm];
+				r0 = rm;
+			}
+		}
+	}
+
+	d->n_nbr = 0;
+	for (r = 0; r < d->np; ++ r) {
+		d->nbr_of[r] = -1;
+		if (r == self) continue;
+		s = .0;
+		for (k = 0; k < N_DIM; ++ k) {
+			e = .0;
+			if (d->lo[N_DIM * r + k] > d->hi[N_DIM * self + k]) e = d->lo[N_DIM * r + k] - d->hi[N_DIM * self + k];
+			else if (d->lo[N_DIM * self + k] > d->hi[N_DIM * r + k]) e = d->lo[N_DIM * self + k] - d->hi[N_DIM * r + k];
+			s += e * e;
+		}
+		if (s <= cutoff_sqr) {
+			d->nbr_of[r] = d->n_nbr;
+			d->nbr[d->n_nbr] = r;
+			d->n_nbr += 1;
+		}
+	}
+}
+
+#endif
@@ -2,26 +2,28 @@
 
 #include <stdio.h>
 #include <string.h>
-#include <stddef.h> 
-#include <stdlib.h> 
-#include <unistd.h> 
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <math.h>
 #include <mpi.h>
 
-#define MAX_N_BODY 50000
+#define MAX_N_BODY 50000  // per rank, and in all: rebalance() gathers every body on rank 0
 #define TIME_INTERVAL 128
+#define BALANCE_INTERVAL 16  // time steps between load checks
+#define BALANCE_TOL 1.10  // rebalance once the slowest rank is this far above the average
 #define G 1.0
 #define N_DIM 3
-#define NP 8
 #define CUTOFF_SQR 25.0
-#define EPSILON 1.0e-6
+#define TAG_COUNT 1
+#define TAG_BODY 2
+#define TAG_HALO 3
+#define HALO_SKIN 1.0  // how far ghosts are picked beyond the cutoff
+#define CKPT_INTERVAL 1024  // default time steps between checkpoints
 
-int ALL_ONES[] = {1, 1, 1, 1, 1, 1, 1, 1};
-
-int octant_dims[][N_DIM] = {
-	{-1, -1, -1}, {1, -1, -1}, {-1, 1, -1}, {1, 1, -1},
-	{-1, -1, 1}, {1, -1, 1}, {-1, 1, 1}, {1, 1, 1}
-};
+#include "cells.h"
+#include "decomp.h"
+#include "snap.h"
 
 typedef struct body_t {
 	double mass;
@@ -29,52 +31,21 @@ typedef struct body_t {
 	double v[N_DIM];
 } Body;
 
-// void sign_of_dims(int rank, int dims[]) {
-// 	dims[2] = (rank / 4) ? 1 : -1;
-// 	dims[1] = ((rank % 4) / 2) ? 1: -1;
-// 	dims[0] = (rank % 2) ? 1 : -1;
-// }
-
-int get_octant_rank(double dims[]) {	
-	return (dims[2] > 0) * 4 + (dims[1] > 0) * 2 + (dims[0] > 0);
-}
-
-void readdata(int *N, int *K, double *DT, Body bodies[], int send_count[], int send_displ[]) {
-	int i, sum, i_oct;
-	Body bds[MAX_N_BODY];
-	int ptrs[NP];
+void readdata(int *N, int *K, double *DT, Body bds[]) {
+	int i;
 
 	scanf("%d", N);
 	scanf("%d", K);
 	scanf("%lf", DT);
 	for (i = 0; i < *N; ++ i) scanf("%lf", &bds[i].mass);
-	memset(send_count, 0, NP * sizeof(int));
-	for (i = 0; i < *N; ++ i) {
-		scanf("%lf %lf %lf", &(bds[i].x)[0], &(bds[i].x)[1], &(bds[i].x)[2]);
-		i_oct = get_octant_rank(bds[i].x);
-		send_count[i_oct] += 1;
-	}
+	for (i = 0; i < *N; ++ i) scanf("%lf %lf %lf", &(bds[i].x)[0], &(bds[i].x)[1], &(bds[i].x)[2]);
 	for (i = 0; i < *N; ++ i) scanf("%lf %lf %lf", &(bds[i].v)[0], &(bds[i].v)[1], &(bds[i].v)[2]);
-	
-	sum = 0;
-	for (i = 0; i < NP; ++ i) {
-		send_displ[i] = sum;
-		sum += send_count[i];
-	}  // offset in form of 'num of Body'
-	memcpy(ptrs, send_displ, NP * sizeof(int));
-	
-	// put each body into its octant's slot
-	for (i = 0; i < *N; ++ i) {
-		i_oct = get_octant_rank(bds[i].x);
-		memcpy(&bodies[ptrs[i_oct]], &bds[i], sizeof(Body));
-		ptrs[i_oct] += 1;
-	}
 }
 
-Body get_centroid(int N, int n_bodies[], Body bodies[]) {
+Body get_centroid(int N, const int n_bodies[], const Body bodies[]) {
 	// N is the size of two array parameters
-	// bodies[i] represents centroid of n_bodies[i] items
-	int i, k, sum_n_body = 0;
+	// bodies[i] represents centroid of n_bodies[i] items, or of one if n_bodies is NULL
+	int i, k, n, sum_n_body = 0;
 	Body centroid;
 
 	centroid.mass = .0;  // centroid's mass is sum rather than avg
@@ -82,11 +53,12 @@ Body get_centroid(int N, int n_bodies[], Body bodies[]) {
 	if (N == 0) return centroid;  // avoid nan
 
 	for (i = 0; i < N; ++ i) {
-		sum_n_body += n_bodies[i % NP];  // N may exceed 8, but ALL_ONE is limited to length NP
+		n = n_bodies ? n_bodies[i] : 1;
+		sum_n_body += n;
 		centroid.mass += bodies[i].mass;
 		for (k = 0; k < N_DIM; ++ k) {
 			centroid.x[k] += bodies[i].mass * bodies[i].x[k];
-			centroid.v[k] += n_bodies[i % NP] * bodies[i].v[k];
+			centroid.v[k] += n * bodies[i].v[k];
 		}
 	}
 
@@ -97,37 +69,23 @@ Body get_centroid(int N, int n_bodies[], Body bodies[]) {
 	return centroid;
 }
 
-void report(int t, double DT, int n_bodies[], Body centroids[]) {
+void report(int t, double DT, int np, int n_bodies[], Body centroids[]) {
 	int i;
 	Body c;
-	c = get_centroid(NP, n_bodies, centroids);
+	c = get_centroid(np, n_bodies, centroids);
 	printf("\n\nConditions after timestep %d (time = %lf) :\n\n", t, t * DT);
 	printf("\tCenter of Mass:\t(%e, %e, %e)\n", c.x[0], c.x[1], c.x[2]);
 	printf("\tAverage Velocity:\t(%e, %e, %e)\n", c.v[0], c.v[1], c.v[2]);
-	printf("\tBodies in octants' distribution:");
-	for (i = 0; i < NP; ++ i) printf(" %d", n_bodies[i]);
+	printf("\tBodies in ranks' distribution:");
+	for (i = 0; i < np; ++ i) printf(" %d", n_bodies[i]);
 	printf("\n");
 }
 
-// decide whether the body should be transferred to each of the other octants
-void shouldSend(double pos[N_DIM], int transmit[NP]) {
-	int o, k;
-	double dist;
-
-	for (o = 0; o < NP; ++ o) {
-		dist = .0;
-		for (k = 0; k < N_DIM; ++ k)
-			if (octant_dims[o][k] * pos[k] < .0) dist += pow(pos[k], 2);
-		if (abs(dist) < EPSILON || dist > CUTOFF_SQR) transmit[o] = 0;
-		else transmit[o] = 1;
-	}
-}
-
 void compute_force_as_vector(const Body *this, const Body *that, double vec[]) {
 	// no init of F[] happens inside
 	double r2, tmp;
 	int k;
-	
+
 	if (this == that) return;
 	r2 = pow(this->x[0] - that->x[0], 2) + pow(this->x[1] - that->x[1], 2) + pow(this->x[2] - that->x[2], 2);
 	if (r2 > CUTOFF_SQR) return;  // too far to have forces between 'em
@@ -135,206 +93,561 @@ void compute_force_as_vector(const Body *this, const Body *that, double vec[]) {
 	for (k = 0; k < N_DIM; ++ k) vec[k] += tmp * (that->x[k] - this->x[k]);  // vector variable
 }
 
-int main(int argc, char **argv) {
-	int N;  // number of bodies
-	int K;  // number of time steps
-	double DT;  // time step size
-	
-	double a[N_DIM];  // acceleration in each dimension
-	double F[N_DIM];  // force in ea1ch dimension
-	int i, j, k, t;
-	int sum;  // send sum & recv sum of each process
-
-	MPI_Status status;
-	MPI_Datatype mpi_body_t;
-	int rank, i_oct;
-	int n_body;  // num of bodies that the very process (octant) holds
-
-	Body centroid;  // to store partial centroid of each octant
-	Body bodies[MAX_N_BODY];  // bodies that the very process (octant) holds
-	int n_bodies[NP];  // overall storage place to collect all n_body from processes
-	int transmit[NP];  // flags of whether the body will possibly exert forces on bodies in other octants
-	int exile[MAX_N_BODY];  // flags of whether the body will be moved out of current octant's range
-
-	// MPI collective operation supporting data structures
-	int send_count[NP];
-	int send_displ[NP];
-	int recv_count[NP];
-	int recv_displ[NP];
-	Body sendbuf[MAX_N_BODY];
-	Body recvbuf[MAX_N_BODY];
-	int ptrs[NP]; // series of pointers that used for filling the send buffer
-	
-	// variables used to create a new MPI type for easy transfer
-	int block_length_array[] = {1, N_DIM, N_DIM};
-	MPI_Aint displ_array[] = {offsetof(Body, mass), offsetof(Body, x), offsetof(Body, v)};
-	MPI_Datatype types[] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE};
-	double wct;
+void check_room(int n, const char *what) {
+	if (n <= MAX_N_BODY) return;
+	printf("%d bodies do not fit in the %s buffer!\n", n, what);
+	MPI_Abort(MPI_COMM_WORLD, 1);
+}
 
-	// Environment initialization
-	MPI_Init(&argc, &argv); // Required MPI initialization call
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
+// Sends send_count[q] bodies at sendbuf + send_displ[q] to each neighbor
+// d->nbr[q] and receives theirs into recvbuf, one after the other in
+// neighbor order. Returns the number of bodies received.
+int exchange(const Domain *d, Body sendbuf[], int send_count[], int send_displ[],
+	Body recvbuf[], int recv_count[], MPI_Datatype type, MPI_Request req[]) {
+	int q, sum;
 
-	// create mpi version of Body for transmission
-	MPI_Type_create_struct(3, block_length_array, displ_array, types, &mpi_body_t);
-	MPI_Type_commit(&mpi_body_t);
+	for (q = 0; q < d->n_nbr; ++ q) {
+		MPI_Irecv(&recv_count[q], 1, MPI_INT, d->nbr[q], TAG_COUNT, MPI_COMM_WORLD, &req[q]);
+		MPI_Isend(&send_count[q], 1, MPI_INT, d->nbr[q], TAG_COUNT, MPI_COMM_WORLD, &req[d->n_nbr + q]);
+	}
+	MPI_Waitall(2 * d->n_nbr, req, MPI_STATUSES_IGNORE);
 
-	// Read metadata from input stream
-	// & distribute bodies to corresponding octants & init send_displ
-	readdata(&N, &K, &DT, bodies, n_bodies, send_displ);
+	sum = 0;
+	for (q = 0; q < d->n_nbr; ++ q) sum += recv_count[q];
+	check_room(sum, "receive");
+	sum = 0;
+	for (q = 0; q < d->n_nbr; ++ q) {
+		MPI_Irecv(&recvbuf[sum], recv_count[q], type, d->nbr[q], TAG_BODY, MPI_COMM_WORLD, &req[q]);
+		MPI_Isend(&sendbuf[send_displ[q]], send_count[q], type, d->nbr[q], TAG_BODY, MPI_COMM_WORLD, &req[d->n_nbr + q]);
+		sum += recv_count[q];
+	}
+	MPI_Waitall(2 * d->n_nbr, req, MPI_STATUSES_IGNORE);
+	return sum;
+}
 
-	// Root process broadcast metadata to workers
-	MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
-	MPI_Bcast(&K, 1, MPI_INT, 0, MPI_COMM_WORLD);
-	MPI_Bcast(&DT, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+// Collects every body on rank 0, bisects space again weighting each body by
+// the measured force time per body of the rank that had it (cost), and
+// hands the bodies out to their new owners. gathered and sorted are
+// scratch space for rank 0.
+void rebalance(Domain *d, int rank, Body bodies[], int *n_body, double cost,
+	Body gathered[], Body sorted[], MPI_Datatype mpi_body_t) {
+	int np = d->np, r, i, k, total = 0, n_cost;
+	int *counts = NULL, *displs = NULL, *idx = NULL, *owner = NULL;
+	double *costs = NULL, *x = NULL, *w = NULL, avg;
 
-	MPI_Scatter(n_bodies, 1, MPI_INT, &n_body, 1, MPI_INT, 0, MPI_COMM_WORLD);
-	MPI_Scatterv(bodies, n_bodies, send_displ, mpi_body_t, 
-		recvbuf, n_body, mpi_body_t, 0, MPI_COMM_WORLD);
+	if (rank == 0) {
+		counts = (int *) malloc(np * sizeof(int));
+		displs = (int *) malloc(np * sizeof(int));
+		costs = (double *) malloc(np * sizeof(double));
+	}
+	MPI_Gather(n_body, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Gather(&cost, 1, MPI_DOUBLE, costs, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	if (rank == 0) {
+		for (r = 0; r < np; ++ r) {
+			displs[r] = total;
+			total += counts[r];
+		}
+		check_room(total, "gather");
+	}
+	MPI_Gatherv(bodies, *n_body, mpi_body_t, gathered, counts, displs, mpi_body_t, 0, MPI_COMM_WORLD);
 
-	MPI_Barrier(MPI_COMM_WORLD);
-	memcpy(bodies, recvbuf, n_body * sizeof(Body));  // now we can treat recvbuf as released
+	if (rank == 0) {
+		// ranks without a measurement yet count as average
+		avg = .0;
+		n_cost = 0;
+		for (r = 0; r < np; ++ r) {
+			if (costs[r] > .0) {
+				avg += costs[r];
+				n_cost += 1;
+			}
+		}
+		avg = n_cost ? avg / n_cost : 1.0;
+		x = (double *) malloc(N_DIM * (total + 1) * sizeof(double));
+		w = (double *) malloc((total + 1) * sizeof(double));
+		idx = (int *) malloc((total + 1) * sizeof(int));
+		owner = (int *) malloc((total + 1) * sizeof(int));
+		if (x == NULL || w == NULL || idx == NULL || owner == NULL) {
+			printf("Cannot allocate the bisection of %d bodies!\n", total);
+			MPI_Abort(MPI_COMM_WORLD, 1);
+		}
+		for (r = 0; r < np; ++ r) {
+			for (i = displs[r]; i < displs[r] + counts[r]; ++ i) {
+				for (k = 0; k < N_DIM; ++ k) x[N_DIM * i + k] = gathered[i].x[k];
+				w[i] = costs[r] > .0 ? costs[r] : avg;
+				idx[i] = i;
+			}
+		}
+		domain_bisect(d, x, w, idx, total, 0, np);
+	}
+	MPI_Bcast(d->axis, np, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Bcast(d->cut, np, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
-	// Main calculation loop
-	wct = MPI_Wtime();
-	for (t = 0; t < K; ++ t) {
-		if (t % TIME_INTERVAL == 0) { // centroid collect & report body distribution
-			centroid = get_centroid(n_body, ALL_ONES, bodies);
-			MPI_Gather(&n_body, 1, MPI_INT, n_bodies, 1, MPI_INT, 0, MPI_COMM_WORLD);
-			MPI_Gather(&centroid, 1, mpi_body_t, recvbuf, 1, mpi_body_t, 0, MPI_COMM_WORLD);
-			if (rank == 0) report(t, DT, n_bodies, recvbuf);
+	if (rank == 0) {
+		memset(counts, 0, np * sizeof(int));
+		for (i = 0; i < total; ++ i) {
+			owner[i] = domain_owner(d, gathered[i].x);
+			counts[owner[i]] += 1;
+		}
+		displs[0] = 0;
+		for (r = 1; r < np; ++ r) displs[r] = displs[r - 1] + counts[r - 1];
+		for (i = 0; i < total; ++ i) {
+			memcpy(&sorted[displs[owner[i]]], &gathered[i], sizeof(Body));
+			displs[owner[i]] += 1;
 		}
+		for (r = 0; r < np; ++ r) displs[r] -= counts[r];
+	}
+	MPI_Scatter(counts, 1, MPI_INT, n_body, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	MPI_Scatterv(sorted, counts, displs, mpi_body_t, bodies, *n_body, mpi_body_t, 0, MPI_COMM_WORLD);
+	domain_finish(d, rank, pow(sqrt(CUTOFF_SQR) + HALO_SKIN, 2));
+
+	free(counts);
+	free(displs);
+	free(costs);
+	free(x);
+	free(w);
+	free(idx);
+	free(owner);
+}
 
-		/* Prepare sending bodies within 5DU to other octants */
-		memset(send_count, 0, NP * sizeof(int));
+// Own bodies that go into a neighbor's halo, with persistent requests that
+// move nothing but their positions. The halo reaches HALO_SKIN beyond the
+// cutoff, and the selection is kept for as long as halo_margins() says
+// that no pair within the cutoff can have been left out.
+typedef struct halo_t {
+	int n_nbr;  // neighbors the requests were made for
+	int n_sel, sel_cap;
+	int *sel;  // own bodies sent to each neighbor, one neighbor after the other
+	int *sel_first;  // where each neighbor's bodies start in sel, n_nbr + 1 entries
+	int *edge;  // whether own body i is in anybody's halo
+	int *mark;  // scratch of halo_margins()
+	MPI_Datatype *pos_t;  // x of the bodies sent to each neighbor, picked out of bodies[]
+	MPI_Request *req;  // receives from each neighbor, then sends
+} Halo;
+
+void halo_init(Halo *h, int np) {
+	h->n_nbr = h->n_sel = h->sel_cap = 0;
+	h->sel = NULL;
+	h->edge = (int *) malloc(MAX_N_BODY * sizeof(int));
+	h->mark = (int *) malloc(MAX_N_BODY * sizeof(int));
+	h->sel_first = (int *) calloc(np + 1, sizeof(int));
+	h->pos_t = (MPI_Datatype *) malloc(np * sizeof(MPI_Datatype));
+	h->req = (MPI_Request *) malloc(2 * np * sizeof(MPI_Request));
+}
+
+void halo_release(Halo *h) {
+	int q;
+	for (q = 0; q < h->n_nbr; ++ q) {
+		MPI_Request_free(&h->req[q]);
+		MPI_Request_free(&h->req[h->n_nbr + q]);
+		MPI_Type_free(&h->pos_t[q]);
+	}
+	h->n_nbr = 0;
+}
 
-		// Compute send_count & set slots for send buffer fulfilling
+void halo_free(Halo *h) {
+	halo_release(h);
+	free(h->sel);
+	free(h->edge);
+	free(h->mark);
+	free(h->sel_first);
+	free(h->pos_t);
+	free(h->req);
+}
+
+// Selects the halo of each neighbor and sends mass and x of those bodies,
+// so that the receivers learn their masses and how many come from where.
+// Then sets up the requests of the following steps: recvbuf keeps the
+// ghosts, and each step overwrites just their x. Returns the number of
+// ghosts.
+int halo_setup(Halo *h, const Domain *d, Body bodies[], int n_body, Body sendbuf[], Body recvbuf[],
+	int send_count[], int send_displ[], int recv_count[], MPI_Request req[],
+	MPI_Datatype mpi_ghost_t, MPI_Datatype mpi_pos_t) {
+	double reach = pow(sqrt(CUTOFF_SQR) + HALO_SKIN, 2);
+	int i, q, sum, n_ghost;
+
+	halo_release(h);
+	memset(h->edge, 0, n_body * sizeof(int));
+	memset(h->mark, 0, n_body * sizeof(int));
+	sum = 0;
+	for (q = 0; q < d->n_nbr; ++ q) {
+		send_displ[q] = sum;
 		for (i = 0; i < n_body; ++ i) {
-			shouldSend(bodies[i].x, transmit);
-			for (j = 0; j < NP; ++ j) {
-				if (transmit[j]) send_count[j] += 1;
+			if (domain_dist2(d, d->nbr[q], bodies[i].x) > reach) continue;
+			if (sum == h->sel_cap) {
+				h->sel_cap = 2 * h->sel_cap + n_body;
+				h->sel = (int *) realloc(h->sel, h->sel_cap * sizeof(int));
 			}
+			h->sel[sum] = i;
+			h->edge[i] = 1;
+			sum += 1;
 		}
+		send_count[q] = sum - send_displ[q];
+		h->sel_first[q] = send_displ[q];
+	}
+	h->sel_first[d->n_nbr] = sum;
+	check_room(sum, "send");
+	h->n_sel = sum;
+	for (i = 0; i < sum; ++ i) memcpy(&sendbuf[i], &bodies[h->sel[i]], sizeof(Body));
+	n_ghost = exchange(d, sendbuf, send_count, send_displ, recvbuf, recv_count, mpi_ghost_t, req);
 
-		sum = 0;  // used as send_sum
-		for (j = 0; j < NP; ++ j) {
-			send_displ[j] = sum;
-			sum += send_count[j];
-		}
-		memcpy(ptrs, send_displ, NP * sizeof(int)); // ptr init
+	sum = 0;
+	for (q = 0; q < d->n_nbr; ++ q) {
+		MPI_Type_create_indexed_block(send_count[q], 1, &h->sel[send_displ[q]], mpi_pos_t, &h->pos_t[q]);
+		MPI_Type_commit(&h->pos_t[q]);
+		MPI_Recv_init(&recvbuf[sum], recv_count[q], mpi_pos_t, d->nbr[q], TAG_HALO, MPI_COMM_WORLD, &h->req[q]);
+		MPI_Send_init(bodies, 1, h->pos_t[q], d->nbr[q], TAG_HALO, MPI_COMM_WORLD, &h->req[d->n_nbr + q]);
+		sum += recv_count[q];
+	}
+	h->n_nbr = d->n_nbr;
+	return n_ghost;
+}
 
-		// Send buffer fulfilling
+// m[0] is how far any own body has strayed out of this rank's box, and
+// -m[1] how far beyond the cutoff the nearest body left out of a
+// neighbor's halo is from that neighbor's box. While the largest m[0] of
+// all ranks stays below both HALO_SKIN / 2 and the smallest -m[1], no body
+// is within the cutoff of a body it is not sent to: its distance to the
+// other body's box minus how far that body strayed exceeds the cutoff.
+// Ranks that are no neighbors have boxes more than HALO_SKIN further apart.
+void halo_margins(Halo *h, const Domain *d, int rank, const Body bodies[], int n_body, double m[2]) {
+	double cutoff = sqrt(CUTOFF_SQR), e;
+	int i, q, k;
+
+	m[0] = .0;
+	m[1] = -HUGE_VAL;
+	for (i = 0; i < n_body; ++ i) {
+		e = sqrt(domain_dist2(d, rank, bodies[i].x));
+		if (e > m[0]) m[0] = e;
+	}
+	for (q = 0; q < h->n_nbr; ++ q) {
+		for (k = h->sel_first[q]; k < h->sel_first[q + 1]; ++ k) h->mark[h->sel[k]] = q + 1;
 		for (i = 0; i < n_body; ++ i) {
-			shouldSend(bodies[i].x, transmit);
-			for (j = 0; j < NP; ++ j) {
-				if (transmit[j]) {
-					memcpy(&sendbuf[ptrs[j]], &bodies[i], sizeof(Body));
-					ptrs[j] += 1;
-				}
+			if (h->mark[i] == q + 1) continue;
+			e = cutoff - sqrt(domain_dist2(d, d->nbr[q], bodies[i].x));
+			if (e > m[1]) m[1] = e;
+		}
+	}
+}
+
+// Advances the own bodies i with edge[i] == which, under the forces of the
+// own bodies and of ghosts[0 .. n_ghost-1]. The cell list is built once, for
+// moves of up to skin / 2, and only used while it is fresh and pays off;
+// *max_move2 keeps the largest squared move.
+void advance(Body bodies[], int n_body, const Body ghosts[], int n_ghost,
+	const int edge[], int which, CellList *cells, double skin, double *max_move2, double DT) {
+	double F[N_DIM], move2;
+	int i, j, k, n_cand, direct = 0;
+	const int *cand;
+
+	for (j = 0; j < n_body; ++ j) cells_set(cells, j, bodies[j].x);
+	for (j = 0; j < n_ghost; ++ j) cells_set(cells, n_body + j, ghosts[j].x);
+	cells_build(cells, n_body + n_ghost, n_body, skin);
+	direct = !cells_pays(cells);
+	for (i = 0; i < n_body; ++ i) {
+		if (edge[i] != which) continue;
+		F[0] = F[1] = F[2] = .0;
+		// forces within the box come first, then those outside of it
+		if (!direct && cells_stale(cells)) direct = 1;  // some own body outran the skin
+		if (direct) {
+			for (j = 0; j < n_body; ++ j) compute_force_as_vector(&bodies[i], &bodies[j], F);
+			for (j = 0; j < n_ghost; ++ j) compute_force_as_vector(&bodies[i], &ghosts[j], F);
+		} else {
+			cand = cells_candidates(cells, i, &n_cand);
+			for (j = 0; j < n_cand; ++ j) {
+				if (cand[j] < n_body) compute_force_as_vector(&bodies[i], &bodies[cand[j]], F);  // accumulates vec variable F
+				else compute_force_as_vector(&bodies[i], &ghosts[cand[j] - n_body], F);
 			}
 		}
+		// scientific formula computing
+		move2 = .0;
+		for (k = 0; k < N_DIM; ++ k) {
+			bodies[i].v[k] += F[k] * (DT / 2.0) / bodies[i].mass;
+			bodies[i].x[k] += bodies[i].v[k] * DT;
+			move2 += bodies[i].v[k] * DT * bodies[i].v[k] * DT;
+		}
+		if (move2 > *max_move2) *max_move2 = move2;
+		cells_moved(cells, i, bodies[i].x);
+	}
+}
 
-		// Notice each other about send_count as recv_count
-		MPI_Barrier(MPI_COMM_WORLD);
-		MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-		MPI_Barrier(MPI_COMM_WORLD);
+// Hands every body outside this rank's box to the neighbor that owns it.
+// Returns 1 if some body has to go to a rank that is not a neighbor; such
+// bodies stay put.
+int migrate(const Domain *d, int rank, Body bodies[], int *n_body, Body sendbuf[], Body recvbuf[],
+	int exile[], int send_count[], int send_displ[], int recv_count[], int ptrs[], MPI_Request req[],
+	MPI_Datatype mpi_body_t) {
+	int i, j, q, sum, i_rank, far = 0;
+
+	memset(send_count, 0, d->np * sizeof(int));
+	for (i = 0; i < *n_body; ++ i) {
+		// check if the body is still within reign of current rank
+		i_rank = domain_owner(d, bodies[i].x);
+		exile[i] = -1;
+		if (i_rank == rank) continue;
+		q = d->nbr_of[i_rank];
+		if (q < 0) far = 1;  // stays here until everything is handed out again
+		else {
+			send_count[q] += 1;  // set size of slots for sendbuf
+			exile[i] = q;  // set a flag in exile array
+		}
+	}
 
-		// Constitutes recv_displ
-		sum = 0;  // used as recv_sum
-		for (j = 0; j < NP; ++ j) {
-			recv_displ[j] = sum;
-			sum += recv_count[j];
+	// Prepare slots for sendbuf
+	sum = 0; // send sum
+	for (q = 0; q < d->n_nbr; ++ q) {
+		send_displ[q] = sum;
+		sum += send_count[q];
+	}
+	memcpy(ptrs, send_displ, d->n_nbr * sizeof(int));
+
+	// Send buffer fulfilling
+	for (i = 0; i < *n_body; ++ i) {
+		q = exile[i];
+		if (q < 0) continue;
+		memcpy(&sendbuf[ptrs[q]], &bodies[i], sizeof(Body));
+		ptrs[q] += 1;
+	}
+	sum = exchange(d, sendbuf, send_count, send_displ, recvbuf, recv_count, mpi_body_t, req);
+
+	// put each received body into missing slots
+	i = sum;
+	for (j = 0; j < *n_body; ++ j) {
+		if (exile[j] < 0) {
+			check_room(i + 1, "body");
+			memcpy(&recvbuf[i], &bodies[j], sizeof(Body));
+			i += 1;
 		}
+	}
+	memcpy(bodies, recvbuf, i * sizeof(Body));
+	*n_body = i;
+	return far;
+}
 
-		// Sending actual bodies that might be useful to other octants
-		MPI_Alltoallv(sendbuf, send_count, send_displ, mpi_body_t,
-			recvbuf, recv_count, recv_displ, mpi_body_t, MPI_COMM_WORLD);
+void usage(const char *prog, int rank) {
+	if (rank == 0) printf("Usage: %s [-r snapshot] [-k steps] [-c checkpoint [-n steps]] [< data]\n", prog);
+	MPI_Finalize();
+	exit(1);
+}
 
-		MPI_Barrier(MPI_COMM_WORLD);
-		// flush send_count; otherwise empty octant will cause bizarre results
-		memset(send_count, 0, NP * sizeof(int));
+int main(int argc, char **argv) {
+	int N;  // number of bodies
+	int K;  // number of time steps
+	double DT;  // time step size
+	int t, t_start = 0;
+
+	// -r: start from a snapshot instead of the text data on stdin; it may
+	//     hold at most MAX_N_BODY bodies, as rebalancing gathers them on rank 0
+	// -k: run up to this time step instead of the one in the input
+	// -c, -n: write a checkpoint every n steps and at the end
+	const char *restart = NULL, *ckpt = NULL;
+	int ckpt_every = CKPT_INTERVAL, k_end = -1, a;
+	SnapHeader head;
+	SnapWriter writer;
+
+	MPI_Datatype mpi_body_t, mpi_ghost_t, mpi_pos_t, tmp_t;
+	int rank, np;
+	int n_body = 0;  // num of bodies that the very process holds
+
+	Body centroid;  // to store partial centroid of each rank
+	Body bodies[MAX_N_BODY];  // bodies that the very process holds
+	int *n_bodies;  // overall storage place to collect all n_body from processes
+	int exile[MAX_N_BODY];  // neighbor the body moves to, -1 if it stays
+	int far, any_far;  // some body left for a rank that is not a neighbor
+
+	// point-to-point exchange with the neighbors, one slot per neighbor
+	Domain dom;
+	int *send_count, *send_displ, *recv_count;
+	int *ptrs; // series of pointers that used for filling the send buffer
+	MPI_Request *req;
+	Body sendbuf[MAX_N_BODY];
+	Body recvbuf[MAX_N_BODY];  // ghosts in between halo setups
 
-		// update status of bodies within the octant
-		for (i = 0; i < n_body; ++ i) {
-			F[0] = F[1] = F[2] = .0;
-			// forces within the octant
-			for (j = 0; j < n_body; ++ j) 
-				compute_force_as_vector(&bodies[i], &bodies[j], F);  // accumulates vec variable F
-			// forces outside of the current octant
-			for (j = 0; j < sum; ++ j)
-				compute_force_as_vector(&bodies[i], &recvbuf[j], F);
-			// scientific formula computing
-			for (k = 0; k < N_DIM; ++ k) {
-				bodies[i].v[k] += F[k] * (DT / 2.0) / bodies[i].mass;
-				bodies[i].x[k] += bodies[i].v[k] * DT; 
-			}
+	Halo halo;
+	int n_ghost = 0;
+	int stale = 1, rebalanced;  // the halo has to be selected again
+	double margin[2], max_margin[2];
+	double halo_bytes = .0, sum_bytes;
+	int n_setup = 0;
 
-			// check if the body is still within reign of current octant
-			i_oct = get_octant_rank(bodies[i].x);
-			if (i_oct != rank) {  // need to be sent to octant [rank = i_oct]
-				send_count[i_oct] += 1;  // set size of slots for sendbuf
-				exile[i] = i_oct;  // set a flag in exile array
-			} else exile[i] = -1;
-		}
+	// own bodies are points 0 .. n_body-1 of the cell list, received ones follow
+	CellList cells;
+	double skin, max_move2 = .0;  // squared distance an own body went in the last step
 
-		/* Communicate with each other to exchange bodies beyond their own reigns */
-		// Prepare slots for sendbuf
-		sum = 0; // send sum
-		for (j = 0; j < NP; ++ j) {
-			send_displ[j] = sum;
-			sum += send_count[j];
-		}
-		
-		memcpy(ptrs, send_displ, NP * sizeof(int));
+	// load measured since the last check
+	double force_time = .0, max_load, sum_load;
+	long body_steps = 0;
+	int n_balance = 0;
 
-		// Send buffer fulfilling
-		for (i = 0; i < n_body; ++ i) {
-			i_oct = exile[i];
-			if (i_oct < 0) continue;
-			memcpy(&sendbuf[ptrs[i_oct]], &bodies[i], sizeof(Body));
-			ptrs[i_oct] += 1;
+	// variables used to create a new MPI type for easy transfer
+	int block_length_array[] = {1, N_DIM, N_DIM};
+	MPI_Aint displ_array[] = {offsetof(Body, mass), offsetof(Body, x), offsetof(Body, v)};
+	MPI_Datatype types[] = {MPI_DOUBLE, MPI_DOUBLE, MPI_DOUBLE};
+	double wct, t0;
+
+	// Environment initialization
+	MPI_Init(&argc, &argv); // Required MPI initialization call
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank); // Which process am I?
+	MPI_Comm_size(MPI_COMM_WORLD, &np);
+
+	for (a = 1; a < argc; a += 2) {
+		if (a + 1 == argc) usage(argv[0], rank);
+		if (strcmp(argv[a], "-r") == 0) restart = argv[a + 1];
+		else if (strcmp(argv[a], "-c") == 0) ckpt = argv[a + 1];
+		else if (strcmp(argv[a], "-n") == 0) ckpt_every = atoi(argv[a + 1]);
+		else if (strcmp(argv[a], "-k") == 0) k_end = atoi(argv[a + 1]);
+		else usage(argv[0], rank);
+	}
+	if (ckpt_every <= 0) usage(argv[0], rank);
+
+	// create mpi version of Body for transmission
+	MPI_Type_create_struct(3, block_length_array, displ_array, types, &mpi_body_t);
+	MPI_Type_commit(&mpi_body_t);
+	// and of what ghosts need, mass & position or just position, strided
+	// so that counts go in bodies
+	MPI_Type_create_struct(2, block_length_array, displ_array, types, &tmp_t);
+	MPI_Type_create_resized(tmp_t, 0, sizeof(Body), &mpi_ghost_t);
+	MPI_Type_commit(&mpi_ghost_t);
+	MPI_Type_free(&tmp_t);
+	MPI_Type_create_struct(1, &block_length_array[1], &displ_array[1], types, &tmp_t);
+	MPI_Type_create_resized(tmp_t, 0, sizeof(Body), &mpi_pos_t);
+	MPI_Type_commit(&mpi_pos_t);
+	MPI_Type_free(&tmp_t);
+
+	domain_init(&dom, np);
+	halo_init(&halo, np);
+	n_bodies = (int *) malloc(np * sizeof(int));
+	send_count = (int *) malloc(np * sizeof(int));
+	send_displ = (int *) malloc(np * sizeof(int));
+	recv_count = (int *) malloc(np * sizeof(int));
+	ptrs = (int *) malloc(np * sizeof(int));
+	req = (MPI_Request *) malloc(2 * np * sizeof(MPI_Request));
+
+	if (restart) {  // every rank reads its own slice
+		snap_read(restart, &head, bodies, &n_body, MAX_N_BODY, mpi_body_t, rank, np);
+		check_room(head.n, "gather");  // the first rebalance takes them all to rank 0
+		N = head.n;
+		K = head.k;
+		t_start = head.t;
+		DT = head.dt;
+	} else {
+		// Read everything on the root & broadcast metadata to workers
+		if (rank == 0) {
+			readdata(&N, &K, &DT, bodies);
+			n_body = N;
 		}
+		MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		MPI_Bcast(&K, 1, MPI_INT, 0, MPI_COMM_WORLD);
+		MPI_Bcast(&DT, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+	}
+	if (k_end >= 0) K = k_end;
+	if (ckpt) snap_init(&writer, ckpt);
 
-		// Notice each other about send_count as recv_count
-		MPI_Barrier(MPI_COMM_WORLD);
-		MPI_Alltoall(send_count, 1, MPI_INT, recv_count, 1, MPI_INT, MPI_COMM_WORLD);
-		MPI_Barrier(MPI_COMM_WORLD);
+	// first decomposition weights every body the same
+	rebalance(&dom, rank, bodies, &n_body, 1.0, recvbuf, sendbuf, mpi_body_t);
+	rebalanced = 1;
+	cells_init(&cells);
+
+	// Main calculation loop
+	wct = MPI_Wtime();
+	for (t = t_start; t < K; ++ t) {
+		if (t % TIME_INTERVAL == 0) { // centroid collect & report body distribution
+			centroid = get_centroid(n_body, NULL, bodies);
+			MPI_Gather(&n_body, 1, MPI_INT, n_bodies, 1, MPI_INT, 0, MPI_COMM_WORLD);
+			MPI_Gather(&centroid, 1, mpi_body_t, sendbuf, 1, mpi_body_t, 0, MPI_COMM_WORLD);
+			if (rank == 0) report(t, DT, np, n_bodies, sendbuf);
+		}
+		// the state the step starts from, written while the steps go on; a
+		// restart does not write back what it just read
+		if (ckpt) {
+			if (t % ckpt_every == 0 && (t > t_start || !restart))
+				snap_start(&writer, bodies, n_body, mpi_body_t, N, K, t, DT, rank);
+			else snap_poll(&writer, rank);
+		}
 
-		// Constitutes recv_displ
-		sum = 0; // recv sum
-		for (j = 0; j < NP; ++ j) {
-			recv_displ[j] = sum;
-			sum += recv_count[j];
+		// the slowest rank sets the pace: bisect again once it falls behind
+		if (t > 0 && t % BALANCE_INTERVAL == 0) {
+			MPI_Allreduce(&force_time, &max_load, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+			MPI_Allreduce(&force_time, &sum_load, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+			if (max_load > BALANCE_TOL * sum_load / np) {
+				rebalance(&dom, rank, bodies, &n_body, body_steps ? force_time / body_steps : .0,
+					recvbuf, sendbuf, mpi_body_t);
+				n_balance += 1;
+				rebalanced = 1;
+			}
+			force_time = .0;
+			body_steps = 0;
 		}
 
-		// Sending actual bodies
-		MPI_Alltoallv(sendbuf, send_count, send_displ, mpi_body_t,
-			recvbuf, recv_count, recv_displ, mpi_body_t, MPI_COMM_WORLD);
-		MPI_Barrier(MPI_COMM_WORLD);
-
-		// put each received body into missing slots
-		i = sum;
-		for (j = 0; j < n_body; ++ j) {
-			if (exile[j] < 0) {
-				memcpy(&recvbuf[i], &bodies[j], sizeof(Body));
-				i += 1;
+		/* Bodies only change hands when the halo is selected again */
+		if (rebalanced || stale) {
+			if (!rebalanced) {
+				far = migrate(&dom, rank, bodies, &n_body, sendbuf, recvbuf, exile,
+					send_count, send_displ, recv_count, ptrs, req, mpi_body_t);
+				// a body that jumped past the neighbors needs a new decomposition
+				MPI_Allreduce(&far, &any_far, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+				if (any_far) {
+					rebalance(&dom, rank, bodies, &n_body, body_steps ? force_time / body_steps : .0,
+						recvbuf, sendbuf, mpi_body_t);
+					n_balance += 1;
+				}
 			}
+			n_ghost = halo_setup(&halo, &dom, bodies, n_body, sendbuf, recvbuf,
+				send_count, send_displ, recv_count, req, mpi_ghost_t, mpi_pos_t);
+			halo_bytes += halo.n_sel * (N_DIM + 1) * sizeof(double) + dom.n_nbr * sizeof(int);
+			n_setup += 1;
+			rebalanced = 0;
+		} else {
+			MPI_Startall(2 * halo.n_nbr, halo.req);
+			halo_bytes += halo.n_sel * N_DIM * sizeof(double);
 		}
-		memcpy(bodies, recvbuf, i * sizeof(Body));
-		// printf("Octant %d : %d + %d -> %d\n", rank, n_body, sum, n_body + sum);
-		n_body = i;
+
+		// bodies nobody needs are not sent, so they can move while the halo is in flight
+		t0 = MPI_Wtime();
+		skin = cells_skin(sqrt(max_move2));
+		max_move2 = .0;
+		advance(bodies, n_body, recvbuf, 0, halo.edge, 0, &cells, skin, &max_move2, DT);
+		force_time += MPI_Wtime() - t0;
+		MPI_Waitall(2 * halo.n_nbr, halo.req, MPI_STATUSES_IGNORE);
+		t0 = MPI_Wtime();
+		advance(bodies, n_body, recvbuf, n_ghost, halo.edge, 1, &cells, skin, &max_move2, DT);
+		force_time += MPI_Wtime() - t0;
+		body_steps += n_body;
+
+		halo_margins(&halo, &dom, rank, bodies, n_body, margin);
+		MPI_Allreduce(margin, max_margin, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+		stale = max_margin[0] >= 0.5 * HALO_SKIN || max_margin[0] >= -max_margin[1];
+	}
+	if (ckpt) {
+		snap_start(&writer, bodies, n_body, mpi_body_t, N, K, t, DT, rank);
+		snap_finish(&writer, rank);
 	}
 	wct = MPI_Wtime() - wct;
 
 	// final centroid collect & report body distribution & timing information
-	centroid = get_centroid(n_body, ALL_ONES, bodies);
+	centroid = get_centroid(n_body, NULL, bodies);
 	MPI_Gather(&n_body, 1, MPI_INT, n_bodies, 1, MPI_INT, 0, MPI_COMM_WORLD);
-	MPI_Gather(&centroid, 1, mpi_body_t, recvbuf, 1, mpi_body_t, 0, MPI_COMM_WORLD);
+	MPI_Gather(&centroid, 1, mpi_body_t, sendbuf, 1, mpi_body_t, 0, MPI_COMM_WORLD);
+	MPI_Reduce(&halo_bytes, &sum_bytes, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 	if (rank == 0) {
-		report(t, DT, n_bodies, recvbuf);
-		printf("Time for %d timesteps with %d bodies\t%lf seconds\n", K, N, wct);
+		report(t, DT, np, n_bodies, sendbuf);
+		printf("Time for %d timesteps with %d bodies\t%lf seconds\n", K - t_start, N, wct);
+		printf("Rebalanced %d times on %d ranks\n", n_balance, np);
+		printf("Halo selected %d times, %.1f KB sent per step\n", n_setup,
+			K > t_start ? sum_bytes / (K - t_start) / 1024 : .0);
 	}
 
+	if (ckpt) snap_free(&writer, rank);
+	halo_free(&halo);
+	cells_free(&cells);
+	domain_free(&dom);
+	free(n_bodies);
+	free(send_count);
+	free(send_displ);
+	free(recv_count);
+	free(ptrs);
+	free(req);
+	MPI_Type_free(&mpi_pos_t);
+	MPI_Type_free(&mpi_ghost_t);
 	MPI_Type_free(&mpi_body_t);
 	MPI_Finalize();
-}
\ No newline at end of file
+}
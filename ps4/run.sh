@@ -14,6 +14,8 @@ make
 
 # mpiexec -n 8 ./fserial < ./data/testdata1 > ./testdata1_f.out
 # mpiexec -n 8 ./fserial < ./data/testdata2 > ./testdata2_f.out
+# mpiexec -n 8 ./fserial -c ./actualdata1.snap -n 256 < ./data/actualdata1 > ./actualdata1_f.out
+# mpiexec -n 8 ./fserial -r ./actualdata1.snap -k 2048 > ./actualdata1_restart_f.out
 
 mpiexec -n 8 ./fserial < ./data/actualdata1 > ./actualdata1_f.out
 mpiexec -n 8 ./fserial < ./data/actualdata2 > ./actualdata2_f.out
@@ -14,6 +14,9 @@ make
 
 # mpiexec -n 8 ./fserial < ./data/testdata1 > ./testdata1_f.out
 # mpiexec -n 8 ./fserial < ./data/testdata2 > ./testdata2_f.out
+# mpiexec -n 1 ./serial nocut < ./data/testdata1 > ./testdata1nocut_s.out
+# mpiexec -n 1 ./serial bh 0.5 check < ./data/testdata1 > ./testdata1bh_s.out
+# mpiexec -n 1 ./serial verlet cut < ./data/actualdata1 > ./actualdata1verlet_s.out
 
 mpiexec -n 1 ./serial < ./data/actualdata1 > ./actualdata1_s.out
 mpiexec -n 1 ./serial < ./data/actualdata2 > ./actualdata2_s.out
@@ -6,14 +6,21 @@
 #include <stdlib.h> 
 #include <unistd.h> 
 #include <math.h>
+#include <omp.h>
 
-#define MAX_N_BODY 50000
 #define TIME_INTERVAL 128
 #define G 1.0
 #define N_DIM 3
 #define CUTOFF_SQR 25.0
 #define EPSILON 0.0001
 
+#include "cells.h"
+#include "bh.h"
+
+#define BH_THETA 0.5  // default opening angle
+#define BH_CHECK 1000  // bodies whose first Barnes-Hut force is checked against the direct sum
+#define SYM_CHUNK 16  // bodies per round-robin chunk of the pair loop
+
 extern void timing(double* wcTime, double* cpuTime);
 
 typedef struct body_t {
@@ -22,15 +29,22 @@ typedef struct body_t {
 	double v[N_DIM];
 } Body;
 
-void readdata(int *N, int *K, double *DT, Body bds[]) {
+Body *readdata(int *N, int *K, double *DT) {
 	int i;
+	Body *bds;
 
 	scanf("%d", N);
 	scanf("%d", K);
 	scanf("%lf", DT);
+	bds = (Body *) malloc((*N > 0 ? *N : 1) * sizeof(Body));
+	if (bds == NULL) {
+		printf("Cannot allocate %d bodies!\n", *N);
+		exit(1);
+	}
 	for (i = 0; i < *N; ++ i) scanf("%lf", &bds[i].mass);
 	for (i = 0; i < *N; ++ i) scanf("%lf %lf %lf", &(bds[i].x)[0], &(bds[i].x)[1], &(bds[i].x)[2]);
 	for (i = 0; i < *N; ++ i) scanf("%lf %lf %lf", &(bds[i].v)[0], &(bds[i].v)[1], &(bds[i].v)[2]);
+	return bds;
 }
 
 Body get_centroid(int n_body, Body bodies[]) {
@@ -53,23 +67,138 @@ Body get_centroid(int n_body, Body bodies[]) {
 	return centroid;
 }
 
-void compute_force_as_vector(const Body *this, const Body *that, double vec[]) {  // no init happens inside
+void compute_force_as_vector(const Body *this, const Body *that, double vec[], double cutoff_sqr) {  // no init happens inside
 	double r2, tmp;
 	int k;
 	
 	if (this == that) return;
 	r2 = pow(this->x[0] - that->x[0], 2) + pow(this->x[1] - that->x[1], 2) + pow(this->x[2] - that->x[2], 2);
-	if (r2 > CUTOFF_SQR) return;
+	if (r2 > cutoff_sqr) return;
 	tmp = (G * this->mass * that->mass) / pow(r2, 1.5);  // quantative variable
 	for (k = 0; k < N_DIM; ++ k) vec[k] += tmp * (that->x[k] - this->x[k]);  // vector variable
 }
 
+// Force between a pair within cutoff_sqr, as felt by this; returns 0 when
+// they are further apart and vec is left alone
+int compute_pair_force(const Body *this, const Body *that, double vec[], double cutoff_sqr) {
+	double r2, tmp;
+	int k;
+
+	r2 = pow(this->x[0] - that->x[0], 2) + pow(this->x[1] - that->x[1], 2) + pow(this->x[2] - that->x[2], 2);
+	if (r2 > cutoff_sqr) return 0;
+	tmp = (G * this->mass * that->mass) / pow(r2, 1.5);
+	for (k = 0; k < N_DIM; ++ k) vec[k] = tmp * (that->x[k] - this->x[k]);
+	return 1;
+}
+
+// Sets F[] to the total force on each body, computing every pair once and
+// adding it to both bodies. Each thread accumulates into its own slice of
+// Fp (3 * N doubles per thread), and the slices are summed in thread order,
+// so a run gives the same result every time for a given thread count. With
+// cells the pairs come from the candidate lists, otherwise from all j > i.
+void compute_forces_sym(const Body bodies[], int N, double F[], double Fp[], double cutoff_sqr, const CellList *cells) {
+	#pragma omp parallel
+	{
+		const int n_thr = omp_get_num_threads();
+		double *Ft = Fp + (size_t) omp_get_thread_num() * N_DIM * N, f[N_DIM];
+		const int *cand;
+		int i, j, k, t, n_cand;
+
+		memset(Ft, 0, (size_t) N_DIM * N * sizeof(double));
+		// rows shrink with i, so small chunks dealt out round robin balance them
+		#pragma omp for schedule(static, SYM_CHUNK)
+		for (i = 0; i < N; ++ i) {
+			if (cells != NULL) {
+				cand = cells_candidates(cells, i, &n_cand);
+				for (j = 0; j < n_cand && cand[j] <= i; ++ j);  // ascending, so the pairs with j > i are at the end
+				for (; j < n_cand; ++ j) {
+					if (!compute_pair_force(&bodies[i], &bodies[cand[j]], f, cutoff_sqr)) continue;
+					for (k = 0; k < N_DIM; ++ k) {
+						Ft[N_DIM * i + k] += f[k];
+						Ft[N_DIM * cand[j] + k] -= f[k];
+					}
+				}
+			} else {
+				for (j = i + 1; j < N; ++ j) {
+					if (!compute_pair_force(&bodies[i], &bodies[j], f, cutoff_sqr)) continue;
+					for (k = 0; k < N_DIM; ++ k) {
+						Ft[N_DIM * i + k] += f[k];
+						Ft[N_DIM * j + k] -= f[k];
+					}
+				}
+			}
+		}
+		#pragma omp for schedule(static)
+		for (i = 0; i < N_DIM * N; ++ i) {
+			F[i] = .0;
+			for (t = 0; t < n_thr; ++ t) F[i] += Fp[(size_t) t * N_DIM * N + i];
+		}
+	}
+}
+
 void report(int t, double DT, const Body* c) {
 	printf("\nConditions after timestep %d (time = %lf) :\n\n", t, t * DT);
 	printf("\tCenter of Mass:\t(%lf, %lf, %lf)\n", c->x[0], c->x[1], c->x[2]);
 	printf("\tAverage Velocity:\t(%lf, %lf, %lf)\n", c->v[0], c->v[1], c->v[2]);
 }
 
+// Sets Fb[] to the Barnes-Hut force on each body, all from the positions
+// the bodies are at now; xs and ms are scratch for the packed bodies
+void bh_forces(BHTree *tree, const Body bodies[], int N, double xs[], double ms[], double Fb[], double theta) {
+	int i, k, p;
+
+	for (i = 0; i < N; ++ i) {
+		for (k = 0; k < N_DIM; ++ k) xs[N_DIM * i + k] = bodies[i].x[k];
+		ms[i] = bodies[i].mass;
+	}
+	bh_build(tree, N, xs, ms);
+	#pragma omp parallel for private(i) schedule(dynamic, 64)
+	for (p = 0; p < N; ++ p) {  // Morton order keeps neighboring bodies on one thread
+		i = tree->keys[p].body;
+		Fb[N_DIM * i] = Fb[N_DIM * i + 1] = Fb[N_DIM * i + 2] = .0;
+		bh_force(tree, p, theta, &Fb[N_DIM * i]);
+	}
+}
+
+// Compares the Barnes-Hut forces of some bodies with the direct sum
+void check_bh(const Body bodies[], int N, const double Fb[], double theta) {
+	double F[N_DIM], err, norm2, ref2, max_err = .0, sum_err2 = .0;
+	int s, n_check = N < BH_CHECK ? N : BH_CHECK, i, j, k;
+
+	if (n_check == 0) return;
+	#pragma omp parallel for private(F, err, norm2, ref2, i, j, k) reduction(+:sum_err2) reduction(max:max_err)
+	for (s = 0; s < n_check; ++ s) {
+		i = (int) ((long) s * N / n_check);
+		F[0] = F[1] = F[2] = .0;
+		for (j = 0; j < N; ++ j) compute_force_as_vector(&bodies[i], &bodies[j], F, HUGE_VAL);
+		norm2 = ref2 = .0;
+		for (k = 0; k < N_DIM; ++ k) {
+			norm2 += pow(Fb[N_DIM * i + k] - F[k], 2);
+			ref2 += F[k] * F[k];
+		}
+		err = ref2 > .0 ? sqrt(norm2 / ref2) : sqrt(norm2);
+		sum_err2 += err * err;
+		if (err > max_err) max_err = err;
+	}
+	printf("\nBarnes-Hut (theta = %lf) force error over %d bodies:\tmax %e, rms %e\n",
+		theta, n_check, max_err, sqrt(sum_err2 / n_check));
+}
+
+// Bins the bodies where they are now, for moves of up to skin / 2
+void bin_bodies(CellList *cells, const Body bodies[], int N, double skin) {
+	int i;
+
+	for (i = 0; i < N; ++ i) cells_set(cells, i, bodies[i].x);
+	cells_build(cells, N, N, skin);
+}
+
+void usage(const char *prog) {
+	printf("Usage: %s [cut | nocut | bh [theta] [check] | verlet [cut | nocut]] < data\n", prog);
+	printf("  bh ... check compares the initial Barnes-Hut forces of up to %d bodies with the\n"
+		"  direct sum before the timed run\n", BH_CHECK);
+	exit(1);
+}
+
 int main(int argc, char **argv) {
 	int N;  // number of bodies
 	int K;  // number of time steps
@@ -78,32 +207,160 @@ int main(int argc, char **argv) {
 	
 	double F[N_DIM];  // force in each dimension
 	int i, j, k, t;
+	int n_cand;  // bodies in the neighborhood of body i
+	const int *cand;
+	int n_build = 0;  // times the cell list was built
+	int direct, n_direct = 0;  // steps finished without the cell list
+	double move2, max_move2 = .0;  // squared distance a body went in one step
+	double cut2;  // squared cutoff of the direct loop
+
+	// cut: 5 DU cutoff; nocut: direct sum over all pairs; bh: Barnes-Hut over all pairs
+	const char *mode = argc > 1 ? argv[1] : "cut";
+	int check = argc > 2 && strcmp(argv[argc - 1], "check") == 0;  // validate bh, outside the timing
+	double theta = argc > 2 + check ? atof(argv[2]) : BH_THETA;
+	int interval = TIME_INTERVAL;
+	int verlet = 0;  // velocity Verlet with each pair computed once, for cut or nocut
 
-	Body bodies[MAX_N_BODY];
+	Body *bodies;
 	Body centroid;
+	CellList cells;
+	BHTree tree;
+	double *xs = NULL, *ms = NULL, *Fb = NULL;  // packed positions, masses and forces for the tree
+	double *Fv = NULL, *Fp = NULL;  // forces and per-thread force slices for verlet
+
+	if (strcmp(mode, "verlet") == 0) {
+		verlet = 1;
+		mode = argc > 2 ? argv[2] : "nocut";
+		if (argc > 3 || (strcmp(mode, "cut") != 0 && strcmp(mode, "nocut") != 0)) usage(argv[0]);
+	} else {
+		if (strcmp(mode, "cut") != 0 && strcmp(mode, "nocut") != 0 && strcmp(mode, "bh") != 0) usage(argv[0]);
+		if (argc > 3 + check || (argc > 2 && (strcmp(mode, "bh") != 0 || theta < .0))) usage(argv[0]);
+	}
+	if (strcmp(mode, "cut") != 0) interval = 1;  // the nocut references report every step
 
-	readdata(&N, &K, &DT, bodies);
+	bodies = readdata(&N, &K, &DT);
+	cells_init(&cells);
+	bh_init(&tree);
+	if (strcmp(mode, "bh") == 0) {
+		xs = (double *) malloc(N_DIM * ((size_t) N + 1) * sizeof(double));
+		ms = (double *) malloc(((size_t) N + 1) * sizeof(double));
+		Fb = (double *) malloc(N_DIM * ((size_t) N + 1) * sizeof(double));
+		if (xs == NULL || ms == NULL || Fb == NULL) {
+			printf("Cannot allocate %d bodies!\n", N);
+			exit(1);
+		}
+	}
+	if (verlet) {
+		Fv = (double *) malloc(N_DIM * ((size_t) N + 1) * sizeof(double));
+		Fp = (double *) malloc(N_DIM * ((size_t) N + 1) * omp_get_max_threads() * sizeof(double));
+		if (Fv == NULL || Fp == NULL) {
+			printf("Cannot allocate %d bodies!\n", N);
+			exit(1);
+		}
+	}
+
+	if (check) {
+		bh_forces(&tree, bodies, N, xs, ms, Fb, theta);
+		check_bh(bodies, N, Fb, theta);
+	}
 
 	timing(&wct, &cpu_t);
+	if (verlet) {  // the first half kick needs the forces at t = 0
+		if (strcmp(mode, "cut") == 0) {
+			bin_bodies(&cells, bodies, N, CELL_SKIN);
+			n_build += 1;
+		}
+		compute_forces_sym(bodies, N, Fv, Fp, strcmp(mode, "cut") == 0 ? CUTOFF_SQR : HUGE_VAL, n_build ? &cells : NULL);
+	}
 	for (t = 0; t < K; ++ t) {
-		if (t % TIME_INTERVAL == 0) {
+		if (t % interval == 0) {
 			centroid = get_centroid(N, bodies);
 			report(t, DT, &centroid);
 		}
+		if (verlet) {
+			// kick by half a step, drift, then kick again with the new forces. The
+			// other modes add F * (DT / 2) / m per step, so each half kick is DT / 4
+			#pragma omp parallel for private(k)
+			for (i = 0; i < N; ++ i) {
+				for (k = 0; k < N_DIM; ++ k) {
+					bodies[i].v[k] += Fv[N_DIM * i + k] * (DT / 4.0) / bodies[i].mass;
+					bodies[i].x[k] += bodies[i].v[k] * DT;
+				}
+			}
+			if (n_build) {
+				for (i = 0; i < N; ++ i) cells_moved(&cells, i, bodies[i].x);
+				if (cells_stale(&cells)) {
+					bin_bodies(&cells, bodies, N, CELL_SKIN);
+					n_build += 1;
+				}
+			}
+			compute_forces_sym(bodies, N, Fv, Fp, strcmp(mode, "cut") == 0 ? CUTOFF_SQR : HUGE_VAL, n_build ? &cells : NULL);
+			#pragma omp parallel for private(k)
+			for (i = 0; i < N; ++ i) {
+				for (k = 0; k < N_DIM; ++ k) bodies[i].v[k] += Fv[N_DIM * i + k] * (DT / 4.0) / bodies[i].mass;
+			}
+			continue;
+		}
+		if (strcmp(mode, "bh") == 0) {
+			bh_forces(&tree, bodies, N, xs, ms, Fb, theta);
+			#pragma omp parallel for private(k)
+			for (i = 0; i < N; ++ i) {
+				for (k = 0; k < N_DIM; ++ k) {
+					bodies[i].v[k] += Fb[N_DIM * i + k] * (DT / 2.0) / bodies[i].mass;
+					bodies[i].x[k] += bodies[i].v[k] * DT; 
+				}
+			}
+			continue;
+		}
+		// one build per step, sized by how far bodies went in the last one
+		direct = strcmp(mode, "nocut") == 0;
+		cut2 = direct ? HUGE_VAL : CUTOFF_SQR;
+		if (!direct) {
+			bin_bodies(&cells, bodies, N, cells_skin(sqrt(max_move2)));
+			n_build += 1;
+			if (!cells_pays(&cells)) {  // too dense for the list to prune anything
+				direct = 1;
+				n_direct += 1;
+			}
+		}
+		max_move2 = .0;
 		for (i = 0; i < N; ++ i) {  // for each body
 			F[0] = F[1] = F[2] = .0;
-			for (j = 0; j < N; ++ j) 
-				compute_force_as_vector(&bodies[i], &bodies[j], F);  // accumulates vec variable F
+			if (!direct && cells_stale(&cells)) {  // some body outran the skin: no list until the next step
+				direct = 1;
+				n_direct += 1;
+			}
+			if (direct) {
+				for (j = 0; j < N; ++ j) 
+					compute_force_as_vector(&bodies[i], &bodies[j], F, cut2);
+			} else {
+				cand = cells_candidates(&cells, i, &n_cand);
+				for (j = 0; j < n_cand; ++ j) 
+					compute_force_as_vector(&bodies[i], &bodies[cand[j]], F, CUTOFF_SQR);  // accumulates vec variable F
+			}
+			move2 = .0;
 			for (k = 0; k < N_DIM; ++ k) {
 				bodies[i].v[k] += F[k] * (DT / 2.0) / bodies[i].mass;
 				bodies[i].x[k] += bodies[i].v[k] * DT; 
+				move2 += bodies[i].v[k] * DT * bodies[i].v[k] * DT;
 			}
+			if (move2 > max_move2) max_move2 = move2;
+			if (n_build) cells_moved(&cells, i, bodies[i].x);
 		}
 	}
 	timing(&cur_t, &cpu_t);
 	centroid = get_centroid(N, bodies);
 	report(t, DT, &centroid);
 	printf("\nTime for %d timesteps with %d bodies\t%lf seconds\n", K, N, cur_t - wct);
+	if (n_build) printf("Cell list built %d times, direct loop in %d steps\n", n_build, n_direct);
+	cells_free(&cells);
+	bh_free(&tree);
+	free(xs);
+	free(ms);
+	free(Fb);
+	free(Fv);
+	free(Fp);
+	free(bodies);
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,148 @@
+#ifndef PS4_SNAP_H
+#define PS4_SNAP_H
+
+/*
+  Binary snapshots of the bodies, read and written with MPI-IO. A file is
+  a SNAP_HEADER byte header followed by one record per body, as laid out
+  by the MPI datatype of a body (mass, x, v: 7 doubles), in the machine's
+  byte order. Bodies carry no identity, so the order of the records does
+  not matter; each rank writes its own at the offset given by the bodies
+  of the ranks before it, and reads an even slice back.
+
+  Checkpoints are written in the background: the bodies are copied aside,
+  nonblocking writes go into "<path>.tmp", and the next checkpoint (or the
+  end of the run) waits for them and renames the file over <path>. So
+  <path> always holds a complete snapshot. Opening and closing a file are
+  collective, so every rank has to start and finish the same checkpoints.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#define SNAP_MAGIC "NBODYSNP"
+#define SNAP_VERSION 1
+#define SNAP_HEADER 64  // bytes before the first record
+#define SNAP_PATH 4096
+
+typedef struct snap_header_t {
+	char magic[8];
+	int version;
+	int n;  // bodies
+	int k;  // time steps of the whole run
+	int t;  // time step the bodies are at
+	double dt;
+} SnapHeader;
+
+typedef struct snap_writer_t {
+	MPI_File fh;
+	MPI_Request req[2];  // own records, then the header on rank 0
+	int busy;  // writes started and not yet waited for
+	char *buf;  // copy of the own records being written
+	size_t cap;
+	char path[SNAP_PATH];
+	SnapHeader head;
+} SnapWriter;
+
+static void snap_die(const char *path, const char *why) {
+	printf("Snapshot %s: %s!\n", path, why);
+	MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+// Reads the header and this rank's even slice of the records into bodies,
+// which holds up to max of them
+static inline void snap_read(const char *path, SnapHeader *h, void *bodies, int *n_body, int max,
+	MPI_Datatype body_t, int rank, int np) {
+	MPI_File fh;
+	int rec, first;
+
+	if (MPI_File_open(MPI_COMM_WORLD, (char *) path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+		snap_die(path, "cannot open");
+	MPI_File_read_at_all(fh, 0, h, sizeof(SnapHeader), MPI_BYTE, MPI_STATUS_IGNORE);
+	if (memcmp(h->magic, SNAP_MAGIC, 8) != 0 || h->version != SNAP_VERSION || h->n < 0)
+		snap_die(path, "not a snapshot of this version");
+
+	first = (int) ((long) h->n * rank / np);
+	*n_body = (int) ((long) h->n * (rank + 1) / np) - first;
+	if (*n_body > max) snap_die(path, "too many bodies per rank");
+	MPI_Type_size(body_t, &rec);
+	MPI_File_read_at_all(fh, SNAP_HEADER + (MPI_Offset) first * rec, bodies, *n_body, body_t, MPI_STATUS_IGNORE);
+	MPI_File_close(&fh);
+}
+
+static inline void snap_init(SnapWriter *w, const char *path) {
+	memset(w, 0, sizeof(SnapWriter));
+	if (strlen(path) + 5 > SNAP_PATH) snap_die(path, "path too long");
+	strcpy(w->path, path);
+}
+
+// Waits for the checkpoint in flight, if any, and puts it in place
+static inline void snap_finish(SnapWriter *w, int rank) {
+	char tmp[SNAP_PATH + 8];
+
+	if (!w->busy) return;
+	MPI_Waitall(rank == 0 ? 2 : 1, w->req, MPI_STATUSES_IGNORE);
+	MPI_File_close(&w->fh);
+	if (rank == 0) {
+		sprintf(tmp, "%s.tmp", w->path);
+		if (rename(tmp, w->path) != 0) snap_die(w->path, "cannot replace");
+	}
+	w->busy = 0;
+}
+
+// Lets the writes in flight progress; call it now and then between checkpoints
+static inline void snap_poll(SnapWriter *w, int rank) {
+	int done;
+	if (w->busy) MPI_Testall(rank == 0 ? 2 : 1, w->req, &done, MPI_STATUSES_IGNORE);
+}
+
+// Starts writing the n_body bodies of this rank, N in total, as the state
+// at time step t, and returns without waiting for the writes
+static inline void snap_start(SnapWriter *w, const void *bodies, int n_body, MPI_Datatype body_t,
+	int N, int K, int t, double DT, int rank) {
+	char tmp[SNAP_PATH + 8];
+	MPI_Aint lb, extent;
+	long before = 0, mine = n_body;
+	size_t bytes;
+	int rec;
+
+	snap_finish(w, rank);
+	MPI_Type_get_extent(body_t, &lb, &extent);
+	bytes = (size_t) n_body * extent;
+	if (bytes > w->cap) {
+		w->cap = bytes + bytes / 2;
+		w->buf = (char *) realloc(w->buf, w->cap);
+		if (w->buf == NULL) snap_die(w->path, "cannot allocate the checkpoint buffer");
+	}
+	memcpy(w->buf, bodies, bytes);
+	MPI_Exscan(&mine, &before, 1, MPI_LONG, MPI_SUM, MPI_COMM_WORLD);
+	if (rank == 0) before = 0;  // undefined there
+
+	sprintf(tmp, "%s.tmp", w->path);
+	if (MPI_File_open(MPI_COMM_WORLD, tmp, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &w->fh) != MPI_SUCCESS)
+		snap_die(tmp, "cannot create");
+	MPI_File_set_size(w->fh, 0);  // an older, longer file must not leave a tail
+	MPI_Type_size(body_t, &rec);
+	MPI_File_iwrite_at(w->fh, SNAP_HEADER + (MPI_Offset) before * rec, w->buf, n_body, body_t, &w->req[0]);
+	if (rank == 0) {
+		memset(&w->head, 0, sizeof(SnapHeader));
+		memcpy(w->head.magic, SNAP_MAGIC, 8);
+		w->head.version = SNAP_VERSION;
+		w->head.n = N;
+		w->head.k = K;
+		w->head.t = t;
+		w->head.dt = DT;
+		MPI_File_iwrite_at(w->fh, 0, &w->head, sizeof(SnapHeader), MPI_BYTE, &w->req[1]);
+	}
+	w->busy = 1;
+}
+
+static inline void snap_free(SnapWriter *w, int rank) {
+	snap_finish(w, rank);
+	free(w->buf);
+	w->buf = NULL;
+	w->cap = 0;
+}
+
+#endif
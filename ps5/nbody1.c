@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
+#include "bench.h"
 
 struct BodyType { 
   float x, y, z;
@@ -52,6 +53,7 @@ void MoveBodies(const int nBodies, struct BodyType* const bodies, const float dt
 }
 
 int main(const int argc, const char** argv) {
+  bench_init(argv[0]);
 
   // Problem size and other parameters
   const int nBodies = (argc > 1 ? atoi(argv[1]) : 16384);
@@ -92,8 +94,11 @@ int main(const int argc, const char** argv) {
   printf("\nPropagating %d bodies using 1 thread on %s...\n\n", 
 	 nBodies, "CPU");
 
-  double rate = 0, dRate = 0; // Benchmarking data
+  BenchStats st; // Benchmarking data
+  char params[32];
   const int skipSteps = 3; // Set this to a positive int to skip warm-up steps
+  // flops and bytes as in nbody0.c: only the arithmetic of the force loop differs
+  bench_stats_init(&st, skipSteps, 20.0*(double)nBodies*(double)(nBodies-1), (24.0 + 12.0 + 24.0 + 12.0)*(double)nBodies);
 
   printf("\033[1m%5s %10s %10s %8s\033[0m\n", "Step", "Time, s", "Interact/s", "GFLOP/s"); fflush(stdout);
 
@@ -108,23 +113,16 @@ int main(const int argc, const char** argv) {
     const float HztoInts   = (float)nBodies * (float)(nBodies-1) ;
     const float HztoGFLOPs = 20.0*1e-9*(float)nBodies*(float)(nBodies-1);
 
-    if (step > skipSteps) { 
-      // Collect statistics 
-      rate  += HztoGFLOPs / (tEnd - tStart); 
-      dRate += HztoGFLOPs * HztoGFLOPs / ((tEnd-tStart)*(tEnd-tStart)); 
-    }
+    bench_add(&st, tEnd - tStart, 1); // Collect statistics past the warm-up
 
     printf("%5d %10.3e %10.3e %8.1f %s\n", 
 	   step, (tEnd-tStart), HztoInts/(tEnd-tStart), HztoGFLOPs/(tEnd-tStart), (step<=skipSteps?"*":""));
     fflush(stdout);
   }
 
-  rate/=(double)(nSteps-skipSteps); 
-  dRate=sqrt(fabs(dRate/(double)(nSteps-skipSteps)-rate*rate));
-
+  sprintf(params, "N=%d", nBodies);
   printf("-----------------------------------------------------\n");
-  printf("\033[1m%s %4s \033[42m%10.1f +- %.1f GFLOP/s\033[0m\n",
-	 "Average performance:", "", rate, dRate);
+  bench_report("MoveBodies", params, 1, &st);
   printf("-----------------------------------------------------\n");
   printf("* - warm-up, not included in average\n\n");
 
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
+#include "bench.h"
 #include <string.h>
 
 #define N 32768
@@ -77,6 +78,7 @@ Centroid get_centroid(const int nBodies, struct BodySet* const bodies) {
 }
 
 int main(const int argc, const char** argv) {
+  bench_init(argv[0]);
   omp_set_num_threads(8);
   // Problem size and other parameters
   const int nBodies = (argc > 1 ? atoi(argv[1]) : 16384);
@@ -109,8 +111,12 @@ int main(const int argc, const char** argv) {
   printf("\nPropagating %d bodies using %d thread on %s...\n\n", 
 	 nBodies, omp_get_num_threads(), "CPU");
 
-  double rate = 0, dRate = 0; // Benchmarking data
+  BenchStats st; // Benchmarking data
+  char params[32];
   const int skipSteps = 3; // Set this to a positive int to skip warm-up steps
+  // 20 flops per interaction; SoA changes the layout, not the traffic: each of the two
+  // loops reads 24 bytes per body and writes 12
+  bench_stats_init(&st, skipSteps, 20.0*(double)nBodies*(double)(nBodies-1), (24.0 + 12.0 + 24.0 + 12.0)*(double)nBodies);
 
   printf("\033[1m%5s %10s %10s %8s\033[0m\n", "Step", "Time, s", "Interact/s", "GFLOP/s"); fflush(stdout);
 
@@ -125,23 +131,16 @@ int main(const int argc, const char** argv) {
     const float HztoInts   = (float)nBodies * (float)(nBodies-1) ;
     const float HztoGFLOPs = 20.0*1e-9*(float)nBodies*(float)(nBodies-1);
 
-    if (step > skipSteps) { 
-      // Collect statistics 
-      rate  += HztoGFLOPs / (tEnd - tStart); 
-      dRate += HztoGFLOPs * HztoGFLOPs / ((tEnd-tStart)*(tEnd-tStart)); 
-    }
+    bench_add(&st, tEnd - tStart, 1); // Collect statistics past the warm-up
 
     printf("%5d %10.3e %10.3e %8.1f %s\n", 
 	   step, (tEnd-tStart), HztoInts/(tEnd-tStart), HztoGFLOPs/(tEnd-tStart), (step<=skipSteps?"*":""));
     fflush(stdout);
   }
 
-  rate/=(double)(nSteps-skipSteps); 
-  dRate=sqrt(fabs(dRate/(double)(nSteps-skipSteps)-rate*rate));
-
+  sprintf(params, "N=%d", nBodies);
   printf("-----------------------------------------------------\n");
-  printf("\033[1m%s %4s \033[42m%10.1f +- %.1f GFLOP/s\033[0m\n",
-	 "Average performance:", "", rate, dRate);
+  bench_report("MoveBodies", params, 8, &st);
   printf("-----------------------------------------------------\n");
   printf("* - warm-up, not included in average\n\n");
 
@@ -2,83 +2,114 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
+#include "bench.h"
 #include <string.h>
 
 #define N 32768
 #define TILE_SZ 2
-#define N_THREADS 8
+#define N_THREADS 8  // default team size, argv[2] overrides it
+
+// j-bodies are streamed in blocks whose positions take half of L1, and each
+// block is reused by all tiles of an I_CHUNK of i-bodies before moving on
+#define L1_BYTES 32768
+#define J_TILE ((int) (L1_BYTES / 2 / (3 * sizeof(float)) / 256 * 256))
+#define I_CHUNK 256
 
 struct BodySet { 
-  float x[N], y[N], z[N];
+  float x[2][N], y[2][N], z[2][N];  // positions before and after the step
   float vx[N], vy[N], vz[N]; 
+  int cur;  // which positions are current
 };
 
 typedef struct {
   float x, y, z;
 } Centroid;
 
-void MoveBodies(const int nBodies, struct BodySet* const bodies, const float dt) {
+// Called by every thread of the team. Positions are read from bodies->cur
+// and the moved ones written to the other set, so they can be updated in
+// the force pass; their sums are added to *sum, which must be zeroed before
+// and is complete after the closing barrier. The caller flips bodies->cur.
+void MoveBodies(const int nBodies, struct BodySet* const bodies, const float dt, Centroid* const sum) {
 
   // Avoid singularity and interaction with self
   const float softening = 1e-20;
+  const float* const x = bodies->x[bodies->cur];
+  const float* const y = bodies->y[bodies->cur];
+  const float* const z = bodies->z[bodies->cur];
+  float* const nx = bodies->x[1 - bodies->cur];
+  float* const ny = bodies->y[1 - bodies->cur];
+  float* const nz = bodies->z[1 - bodies->cur];
+  float comx = 0.0f, comy = 0.0f, comz = 0.0f;
   
-  omp_set_num_threads(N_THREADS);
-  #pragma omp parallel for // private(i, j, k) schedule(dynamic)
-  // Loop over bodies that experience force
-  for (int i = 0; i < nBodies; i += TILE_SZ) {
-    float Fx[TILE_SZ], Fy[TILE_SZ], Fz[TILE_SZ];
-    Fx[:] = Fy[:] = Fz[:] = .0;
-
-    #pragma unroll_and_jam(TILE_SZ)
-    #pragma omp simd
-    // Loop over bodies that exert force: vectorization expected here
-    for (int j = 0; j < nBodies; j ++) {
-      for (int k = i; k < i + TILE_SZ; ++ k) {
-        // Newton's law of universal gravity
-        const float dx = bodies->x[j] - bodies->x[k];
-        const float dy = bodies->y[j] - bodies->y[k];
-        const float dz = bodies->z[j] - bodies->z[k];
-        const float drSquared  = dx*dx + dy*dy + dz*dz + softening;
-        const float drRooted = sqrtf(drSquared);
-        const float drPower32 = drRooted * drSquared;
-        // const float drReciRooted = 1.0f / sqrtf(drSquared);  // all expensive operations happened here
-        const float drPower23 = 1.0f / drPower32;
+  #pragma omp for schedule(static) nowait
+  // Loop over chunks of bodies that experience force
+  for (int i0 = 0; i0 < nBodies; i0 += I_CHUNK) {
+    const int i1 = i0 + I_CHUNK < nBodies ? i0 + I_CHUNK : nBodies;
+    float Fx[I_CHUNK], Fy[I_CHUNK], Fz[I_CHUNK];
+    Fx[0:i1-i0] = Fy[0:i1-i0] = Fz[0:i1-i0] = .0;
+
+    for (int j0 = 0; j0 < nBodies; j0 += J_TILE) {
+      const int j1 = j0 + J_TILE < nBodies ? j0 + J_TILE : nBodies;
+      for (int i = i0; i < i1; i += TILE_SZ) {
+        #pragma unroll_and_jam(TILE_SZ)
+        #pragma omp simd
+        // Loop over bodies that exert force: vectorization expected here
+        for (int j = j0; j < j1; j ++) {
+          for (int k = i; k < i + TILE_SZ; ++ k) {
+            // Newton's law of universal gravity
+            const float dx = x[j] - x[k];
+            const float dy = y[j] - y[k];
+            const float dz = z[j] - z[k];
+            const float drSquared  = dx*dx + dy*dy + dz*dz + softening;
+            const float drRooted = sqrtf(drSquared);
+            const float drPower32 = drRooted * drSquared;
+            // const float drReciRooted = 1.0f / sqrtf(drSquared);  // all expensive operations happened here
+            const float drPower23 = 1.0f / drPower32;
   	
-        // Calculate the net force
-        Fx[k-i] += dx * drPower23;  
-        Fy[k-i] += dy * drPower23;  
-        Fz[k-i] += dz * drPower23;
+            // Calculate the net force
+            Fx[k-i0] += dx * drPower23;  
+            Fy[k-i0] += dy * drPower23;  
+            Fz[k-i0] += dz * drPower23;
+          }
+        }
       }
     }
-    // Accelerate bodies in response to the gravitational force
-    for (int k = i; k < i + TILE_SZ; ++ k) {
-      bodies->vx[k] += dt * Fx[k-i]; 
-      bodies->vy[k] += dt * Fy[k-i]; 
-      bodies->vz[k] += dt * Fz[k-i];
+    // Accelerate bodies in response to the gravitational force, then move them
+    for (int k = i0; k < i1; ++ k) {
+      bodies->vx[k] += dt * Fx[k-i0]; 
+      bodies->vy[k] += dt * Fy[k-i0]; 
+      bodies->vz[k] += dt * Fz[k-i0];
+      nx[k] = x[k] + bodies->vx[k] * dt;
+      ny[k] = y[k] + bodies->vy[k] * dt;
+      nz[k] = z[k] + bodies->vz[k] * dt;
+      comx += nx[k];
+      comy += ny[k];
+      comz += nz[k];
     }
   }
-  // end of parallel section
-  #pragma omp barrier
 
-  #pragma omp parallel for schedule(dynamic)
-  for (int i = 0; i < nBodies; i++) {
-    // Move bodies according to their velocities
-    bodies->x[i] += bodies->vx[i] * dt;
-    bodies->y[i] += bodies->vy[i] * dt;
-    bodies->z[i] += bodies->vz[i] * dt;
-  }
+  #pragma omp atomic
+  sum->x += comx;
+  #pragma omp atomic
+  sum->y += comy;
+  #pragma omp atomic
+  sum->z += comz;
+  #pragma omp barrier
 }
 
 Centroid get_centroid(const int nBodies, struct BodySet* const bodies) {
   float comx = 0.0f, comy=0.0f, comz=0.0f;
+  const float* const x = bodies->x[bodies->cur];
+  const float* const y = bodies->y[bodies->cur];
+  const float* const z = bodies->z[bodies->cur];
   Centroid c;
 
-  #pragma omp parallel for reduction(+:comx)
-    for (int i = 0; i < nBodies; ++ i) comx += bodies->x[i];
-  #pragma omp parallel for reduction(+:comy)
-    for (int i = 0; i < nBodies; ++ i) comy += bodies->y[i];
-  #pragma omp parallel for reduction(+:comz)
-    for (int i = 0; i < nBodies; ++ i) comz += bodies->z[i];
+  #pragma omp parallel for reduction(+:comx, comy, comz)
+    for (int i = 0; i < nBodies; ++ i) {
+      comx += x[i];
+      comy += y[i];
+      comz += z[i];
+    }
   
   c.x = comx / nBodies;
   c.y = comy / nBodies;
@@ -87,24 +118,32 @@ Centroid get_centroid(const int nBodies, struct BodySet* const bodies) {
 }
 
 int main(const int argc, const char** argv) {
-  // omp_set_num_threads(8);
+  bench_init(argv[0]);
   // Problem size and other parameters
   const int nBodies = (argc > 1 ? atoi(argv[1]) : 16384);
+  const int nThreads = (argc > 2 ? atoi(argv[2]) : N_THREADS);
   const int nSteps = 10;  // Duration of test
   const float dt = 0.01f; // Body propagation time step
-  Centroid c;
+  Centroid c, sum;
+
+  if (nBodies <= 0 || nBodies > N || nBodies % TILE_SZ != 0 || nThreads <= 0) {
+    printf("Usage: %s [nBodies <= %d, a multiple of %d] [nThreads]\n", argv[0], N, TILE_SZ);
+    return 1;
+  }
+  omp_set_num_threads(nThreads);  // once; the same team runs every step
 
   // Body data stored as an Array of Structures (AoS)
-  struct BodySet bodies;
+  static struct BodySet bodies;
+  bodies.cur = 0;
 
   // Initialize random number generator and bodies
   srand(0);
   float randmax;
   randmax = (float) RAND_MAX;
   for(int i = 0; i < nBodies; i++) {
-    bodies.x[i] = ((float) rand())/randmax; 
-    bodies.y[i] = ((float) rand())/randmax; 
-    bodies.z[i] = ((float) rand())/randmax; 
+    bodies.x[0][i] = ((float) rand())/randmax; 
+    bodies.y[0][i] = ((float) rand())/randmax; 
+    bodies.z[0][i] = ((float) rand())/randmax; 
     bodies.vx[i] = ((float) rand())/randmax; 
     bodies.vy[i] = ((float) rand())/randmax; 
     bodies.vz[i] = ((float) rand())/randmax; 
@@ -117,46 +156,57 @@ int main(const int argc, const char** argv) {
   // Perform benchmark
   printf("\n\033[1mNBODY Version 04\033[0m\n");
   printf("\nPropagating %d bodies using %d thread on %s...\n\n", 
-	 nBodies, omp_get_num_threads(), "CPU");
+	 nBodies, nThreads, "CPU");
 
-  double rate = 0, dRate = 0; // Benchmarking data
+  BenchStats st; // Benchmarking data
+  char params[32];
   const int skipSteps = 3; // Set this to a positive int to skip warm-up steps
+  // 20 flops per interaction; a single pass per body reads the current positions and the
+  // velocities, and writes the velocities and the other set of positions
+  bench_stats_init(&st, skipSteps, 20.0*(double)nBodies*(double)(nBodies-1), (24.0 + 12.0 + 12.0)*(double)nBodies);
+  double tStart;
 
   printf("\033[1m%5s %10s %10s %8s\033[0m\n", "Step", "Time, s", "Interact/s", "GFLOP/s"); fflush(stdout);
 
+  // One team for all steps, each thread pinned next to the previous one
+  // (set OMP_PLACES=cores to pin to whole cores)
+  #pragma omp parallel proc_bind(close)
   for (int step = 1; step <= nSteps; step++) {
 
-    const double tStart = omp_get_wtime(); // Start timing
-    MoveBodies(nBodies, &bodies, dt);
-    const double tEnd = omp_get_wtime(); // End timing
-
-    // These are for calculating flop rate. It ignores symmetry and 
-    // estimates 20 flops per body-body interaction in MoveBodies
-    const float HztoInts   = (float)nBodies * (float)(nBodies-1) ;
-    const float HztoGFLOPs = 20.0*1e-9*(float)nBodies*(float)(nBodies-1);
-
-    if (step > skipSteps) { 
-      // Collect statistics 
-      rate  += HztoGFLOPs / (tEnd - tStart); 
-      dRate += HztoGFLOPs * HztoGFLOPs / ((tEnd-tStart)*(tEnd-tStart)); 
+    #pragma omp single
+    {
+      sum.x = sum.y = sum.z = 0.0f;
+      tStart = omp_get_wtime(); // Start timing
+    }
+    MoveBodies(nBodies, &bodies, dt, &sum);
+    #pragma omp single
+    {
+      const double tEnd = omp_get_wtime(); // End timing
+      bodies.cur = 1 - bodies.cur;
+
+      // These are for calculating flop rate. It ignores symmetry and 
+      // estimates 20 flops per body-body interaction in MoveBodies
+      const float HztoInts   = (float)nBodies * (float)(nBodies-1) ;
+      const float HztoGFLOPs = 20.0*1e-9*(float)nBodies*(float)(nBodies-1);
+
+      bench_add(&st, tEnd - tStart, 1); // Collect statistics past the warm-up
+
+      printf("%5d %10.3e %10.3e %8.1f %s\n", 
+	     step, (tEnd-tStart), HztoInts/(tEnd-tStart), HztoGFLOPs/(tEnd-tStart), (step<=skipSteps?"*":""));
+      fflush(stdout);
     }
-
-    printf("%5d %10.3e %10.3e %8.1f %s\n", 
-	   step, (tEnd-tStart), HztoInts/(tEnd-tStart), HztoGFLOPs/(tEnd-tStart), (step<=skipSteps?"*":""));
-    fflush(stdout);
   }
 
-  rate/=(double)(nSteps-skipSteps); 
-  dRate=sqrt(fabs(dRate/(double)(nSteps-skipSteps)-rate*rate));
-
+  sprintf(params, "N=%d", nBodies);
   printf("-----------------------------------------------------\n");
-  printf("\033[1m%s %4s \033[42m%10.1f +- %.1f GFLOP/s\033[0m\n",
-	 "Average performance:", "", rate, dRate);
+  bench_report("MoveBodies", params, nThreads, &st);
   printf("-----------------------------------------------------\n");
   printf("* - warm-up, not included in average\n\n");
 
-  // Compute final center of mass
-  c = get_centroid(nBodies, &bodies);
+  // Final center of mass, summed up by the last step
+  c.x = sum.x / nBodies;
+  c.y = sum.y / nBodies;
+  c.z = sum.z / nBodies;
   printf("Final center of mass: (%g, %g, %g)\n", c.x, c.y, c.z);
 
 }
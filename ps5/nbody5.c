@@ -0,0 +1,243 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "bench.h"
+#include <string.h>
+#include <immintrin.h>
+
+/*
+  Hand-vectorized force kernel. The lanes of a vector hold I_VECS * VLEN
+  consecutive i-bodies, which stay in registers for the whole j-loop, and
+  each j-body is broadcast once to all of them. 1/sqrt(r^2) comes from the
+  hardware estimate (12 bits on AVX2, 14 on AVX-512) refined by one Newton
+  step, so there is neither a sqrt nor a divide per interaction.
+*/
+
+#if defined(__AVX512F__)
+#define VLEN 16
+#define I_VECS 4  // 32 zmm registers
+typedef __m512 vfloat;
+#define v_set1 _mm512_set1_ps
+#define v_load _mm512_load_ps
+#define v_store _mm512_store_ps
+#define v_add _mm512_add_ps
+#define v_sub _mm512_sub_ps
+#define v_mul _mm512_mul_ps
+#define v_fmadd _mm512_fmadd_ps
+#define v_fnmadd _mm512_fnmadd_ps
+#define v_rsqrt _mm512_rsqrt14_ps
+#elif defined(__AVX2__) && defined(__FMA__)
+#define VLEN 8
+#define I_VECS 2  // 16 ymm registers
+typedef __m256 vfloat;
+#define v_set1 _mm256_set1_ps
+#define v_load _mm256_load_ps
+#define v_store _mm256_store_ps
+#define v_add _mm256_add_ps
+#define v_sub _mm256_sub_ps
+#define v_mul _mm256_mul_ps
+#define v_fmadd _mm256_fmadd_ps
+#define v_fnmadd _mm256_fnmadd_ps
+#define v_rsqrt _mm256_rsqrt_ps
+#else  // no AVX2: plain floats, exact rsqrt
+#define VLEN 1
+#define I_VECS 4
+typedef float vfloat;
+static inline float v_set1(float a) { return a; }
+static inline float v_load(const float* p) { return *p; }
+static inline void v_store(float* p, float a) { *p = a; }
+static inline float v_add(float a, float b) { return a + b; }
+static inline float v_sub(float a, float b) { return a - b; }
+static inline float v_mul(float a, float b) { return a * b; }
+static inline float v_fmadd(float a, float b, float c) { return a * b + c; }
+static inline float v_fnmadd(float a, float b, float c) { return c - a * b; }
+static inline float v_rsqrt(float a) { return 1.0f / sqrtf(a); }
+#endif
+
+#define TILE_SZ (I_VECS * VLEN)  // i-bodies per tile
+#define ALIGN 64
+
+struct BodySet {
+  int nPad;  // nBodies rounded up to TILE_SZ
+  float *x, *y, *z;
+  float *vx, *vy, *vz;
+};
+
+typedef struct {
+  float x, y, z;
+} Centroid;
+
+// Allocates aligned SoA arrays for nBodies; the padding bodies sit at the
+// origin and only ever appear as i-bodies, whose results are dropped
+void AllocBodies(const int nBodies, struct BodySet* const bodies) {
+  float** arrays[6] = {&bodies->x, &bodies->y, &bodies->z, &bodies->vx, &bodies->vy, &bodies->vz};
+
+  bodies->nPad = (nBodies + TILE_SZ - 1) / TILE_SZ * TILE_SZ;
+  for (int a = 0; a < 6; ++ a) {
+    *arrays[a] = (float*) _mm_malloc(bodies->nPad * sizeof(float), ALIGN);
+    if (*arrays[a] == NULL) {
+      printf("Cannot allocate %d bodies!\n", nBodies);
+      exit(1);
+    }
+    memset(*arrays[a], 0, bodies->nPad * sizeof(float));
+  }
+}
+
+void FreeBodies(struct BodySet* const bodies) {
+  _mm_free(bodies->x); _mm_free(bodies->y); _mm_free(bodies->z);
+  _mm_free(bodies->vx); _mm_free(bodies->vy); _mm_free(bodies->vz);
+}
+
+void MoveBodies(const int nBodies, struct BodySet* const bodies, const float dt) {
+
+  // Avoid singularity and interaction with self
+  const float softening = 1e-20;
+
+  #pragma omp parallel for schedule(static)
+  // Loop over tiles of bodies that experience force
+  for (int i = 0; i < bodies->nPad; i += TILE_SZ) {
+    const vfloat half = v_set1(0.5f), threeHalves = v_set1(1.5f), eps = v_set1(softening);
+    vfloat xi[I_VECS], yi[I_VECS], zi[I_VECS];
+    vfloat Fx[I_VECS], Fy[I_VECS], Fz[I_VECS];
+
+    for (int v = 0; v < I_VECS; ++ v) {
+      xi[v] = v_load(bodies->x + i + v * VLEN);
+      yi[v] = v_load(bodies->y + i + v * VLEN);
+      zi[v] = v_load(bodies->z + i + v * VLEN);
+      Fx[v] = Fy[v] = Fz[v] = v_set1(.0f);
+    }
+
+    // Loop over bodies that exert force, one broadcast each
+    for (int j = 0; j < nBodies; j ++) {
+      const vfloat xj = v_set1(bodies->x[j]), yj = v_set1(bodies->y[j]), zj = v_set1(bodies->z[j]);
+      for (int v = 0; v < I_VECS; ++ v) {
+        // Newton's law of universal gravity
+        const vfloat dx = v_sub(xj, xi[v]);
+        const vfloat dy = v_sub(yj, yi[v]);
+        const vfloat dz = v_sub(zj, zi[v]);
+        const vfloat drSquared = v_fmadd(dx, dx, v_fmadd(dy, dy, v_fmadd(dz, dz, eps)));
+        // y1 = y0 * (1.5 - 0.5 * r^2 * y0^2)
+        const vfloat y0 = v_rsqrt(drSquared);
+        const vfloat drReciRooted = v_mul(y0, v_fnmadd(v_mul(half, drSquared), v_mul(y0, y0), threeHalves));
+        const vfloat drPower23 = v_mul(drReciRooted, v_mul(drReciRooted, drReciRooted));
+
+        // Calculate the net force
+        Fx[v] = v_fmadd(dx, drPower23, Fx[v]);
+        Fy[v] = v_fmadd(dy, drPower23, Fy[v]);
+        Fz[v] = v_fmadd(dz, drPower23, Fz[v]);
+      }
+    }
+
+    // Accelerate bodies in response to the gravitational force
+    const vfloat vdt = v_set1(dt);
+    for (int v = 0; v < I_VECS; ++ v) {
+      float* const vx = bodies->vx + i + v * VLEN;
+      float* const vy = bodies->vy + i + v * VLEN;
+      float* const vz = bodies->vz + i + v * VLEN;
+      v_store(vx, v_fmadd(vdt, Fx[v], v_load(vx)));
+      v_store(vy, v_fmadd(vdt, Fy[v], v_load(vy)));
+      v_store(vz, v_fmadd(vdt, Fz[v], v_load(vz)));
+    }
+  }
+
+  #pragma omp parallel for schedule(static)
+  for (int i = 0; i < nBodies; i++) {
+    // Move bodies according to their velocities
+    bodies->x[i] += bodies->vx[i] * dt;
+    bodies->y[i] += bodies->vy[i] * dt;
+    bodies->z[i] += bodies->vz[i] * dt;
+  }
+}
+
+Centroid get_centroid(const int nBodies, struct BodySet* const bodies) {
+  float comx = 0.0f, comy=0.0f, comz=0.0f;
+  Centroid c;
+
+  #pragma omp parallel for reduction(+:comx, comy, comz)
+    for (int i = 0; i < nBodies; ++ i) {
+      comx += bodies->x[i];
+      comy += bodies->y[i];
+      comz += bodies->z[i];
+    }
+
+  c.x = comx / nBodies;
+  c.y = comy / nBodies;
+  c.z = comz / nBodies;
+  return c;
+}
+
+int main(const int argc, const char** argv) {
+  bench_init(argv[0]);
+  // Problem size and other parameters
+  const int nBodies = (argc > 1 ? atoi(argv[1]) : 16384);
+  const int nSteps = 10;  // Duration of test
+  const float dt = 0.01f; // Body propagation time step
+  Centroid c;
+
+  // Body data stored as a Structure of aligned Arrays (SoA) on the heap
+  struct BodySet bodies;
+  AllocBodies(nBodies, &bodies);
+
+  // Initialize random number generator and bodies
+  srand(0);
+  float randmax;
+  randmax = (float) RAND_MAX;
+  for(int i = 0; i < nBodies; i++) {
+    bodies.x[i] = ((float) rand())/randmax;
+    bodies.y[i] = ((float) rand())/randmax;
+    bodies.z[i] = ((float) rand())/randmax;
+    bodies.vx[i] = ((float) rand())/randmax;
+    bodies.vy[i] = ((float) rand())/randmax;
+    bodies.vz[i] = ((float) rand())/randmax;
+  }
+
+  // Compute initial center of mass
+  c = get_centroid(nBodies, &bodies);
+  printf("Initial center of mass: (%g, %g, %g)\n", c.x, c.y, c.z);
+
+  // Perform benchmark
+  printf("\n\033[1mNBODY Version 05\033[0m\n");
+  printf("\nPropagating %d bodies using %d thread on %s (%d-wide vectors, %d i-bodies per tile)...\n\n",
+	 nBodies, omp_get_max_threads(), "CPU", VLEN, TILE_SZ);
+
+  BenchStats st; // Benchmarking data
+  char params[32];
+  const int skipSteps = 3; // Set this to a positive int to skip warm-up steps
+  // 20 flops per interaction; as in nbody3.c the move loop is separate, so the
+  // positions and velocities go through memory twice
+  bench_stats_init(&st, skipSteps, 20.0*(double)nBodies*(double)(nBodies-1), (24.0 + 12.0 + 24.0 + 12.0)*(double)nBodies);
+
+  printf("\033[1m%5s %10s %10s %8s\033[0m\n", "Step", "Time, s", "Interact/s", "GFLOP/s"); fflush(stdout);
+
+  for (int step = 1; step <= nSteps; step++) {
+
+    const double tStart = omp_get_wtime(); // Start timing
+    MoveBodies(nBodies, &bodies, dt);
+    const double tEnd = omp_get_wtime(); // End timing
+
+    // These are for calculating flop rate. It ignores symmetry and
+    // estimates 20 flops per body-body interaction in MoveBodies, as the
+    // earlier versions do, so the rates compare directly
+    const float HztoInts   = (float)nBodies * (float)(nBodies-1) ;
+    const float HztoGFLOPs = 20.0*1e-9*(float)nBodies*(float)(nBodies-1);
+
+    bench_add(&st, tEnd - tStart, 1); // Collect statistics past the warm-up
+
+    printf("%5d %10.3e %10.3e %8.1f %s\n",
+	   step, (tEnd-tStart), HztoInts/(tEnd-tStart), HztoGFLOPs/(tEnd-tStart), (step<=skipSteps?"*":""));
+    fflush(stdout);
+  }
+
+  sprintf(params, "N=%d", nBodies);
+  printf("-----------------------------------------------------\n");
+  bench_report("MoveBodies", params, omp_get_max_threads(), &st);
+  printf("-----------------------------------------------------\n");
+  printf("* - warm-up, not included in average\n\n");
+
+  // Compute final center of mass
+  c = get_centroid(nBodies, &bodies);
+  printf("Final center of mass: (%g, %g, %g)\n", c.x, c.y, c.z);
+
+  FreeBodies(&bodies);
+}
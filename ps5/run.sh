@@ -7,3 +7,4 @@ make TARGETS=nbody1 TARGETOBJECTS=nbody1.o
 make TARGETS=nbody2 TARGETOBJECTS=nbody2.o
 make TARGETS=nbody3 TARGETOBJECTS=nbody3.o
 make TARGETS=nbody4 TARGETOBJECTS=nbody4.o
+make TARGETS=nbody5 TARGETOBJECTS=nbody5.o
\ No newline at end of file
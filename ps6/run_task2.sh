@@ -17,3 +17,11 @@ device=2
 ./task2 8192 8192 1024 $device
 # ./task1 8192 8192 8192 2
 # ./task1 1024 1024 1024 2
+# tiled FP32 against tensor cores with FP16 inputs and FP32 accumulation
+./task3 8192 8192 8192 $device fp32
+./task3 8192 8192 8192 $device fp16
+./task3 1000 3000 1500 $device fp16
+# batched: pinned memory, streamed tiles of c, then spread over all three GPUs
+./task3 8192 8192 8192 $device fp32 0
+./task3 8192 8192 8192 0,1,2 fp32
+./task3 32768 8192 32768 0,1,2 fp16
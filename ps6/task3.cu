@@ -1,13 +1,37 @@
 #define FP float
-#define TW 32
-#define TH 7
 
 #include <stdio.h>
 #include <cuda.h>
+#include <cuda_fp16.h>
+#include <mma.h>
+#ifdef WITH_BF16
+#include <cuda_bf16.h>
+#endif
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
-
-__global__ void gpu_matmul_tiled(FP *a,FP *b, FP *c, int n, int p, int m) {
+#include <sys/time.h>
+
+// Tensor cores need sm_70 (sm_80 for bfloat16, and then the fp16 path shares
+// that build). task3 is also compiled for older GPUs so the FP32 path runs
+// there; on those the wmma kernels are compiled empty and main() refuses the
+// tensor-core precisions.
+#ifdef WITH_BF16
+#define WMMA_ARCH 800
+#else
+#define WMMA_ARCH 700
+#endif
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ < WMMA_ARCH
+#define NO_WMMA
+#else
+using namespace nvcuda;
+#endif
+
+// FP32 path: a TW x TW block of threads computes a TW x (TH*TW) tile of c,
+// every thread keeping TH results in registers. Loads past the edges of a and
+// b read as zero, so n, p and m need not be multiples of the tile.
+template <int TW, int TH>
+__global__ void gpu_matmul_tiled(const FP *a, const FP *b, FP *c, int n, int p, int m) {
 
     FP cvalues[TH];
     __shared__ FP atile[TW][TW], btile[TH][TW][TW];
@@ -23,13 +47,12 @@ __global__ void gpu_matmul_tiled(FP *a,FP *b, FP *c, int n, int p, int m) {
         cvalues[i] = 0;
     }
 
-    // loop over tiles
-    for (int i = 0; i < p / TW; ++ i) {
-        atile[ty][tx] = a[row*p + i*TW + tx]; //Copy to shared memory
+    // loop over tiles, the last one may be partial
+    for (int i = 0; i < (p + TW - 1) / TW; ++ i) {
+        int ka = i * TW + tx, kb = i * TW + ty;
+        atile[ty][tx] = (row < n && ka < p) ? a[row*p + ka] : 0; //Copy to shared memory
         for (int j = 0; j < TH; ++ j) {
-            if (cols[j] < m) {  //Copy to shared memory
-                btile[j][ty][tx] = b[(i * TW + ty) * m + cols[j]];
-            }
+            btile[j][ty][tx] = (kb < p && cols[j] < m) ? b[kb * m + cols[j]] : 0;
         }
         __syncthreads();
 
@@ -43,25 +66,331 @@ __global__ void gpu_matmul_tiled(FP *a,FP *b, FP *c, int n, int p, int m) {
 
     // copy back to shared results
     for (int j = 0; j < TH; ++ j) {
-        if (cols[j] < m) {
+        if (row < n && cols[j] < m) {
             c[row * m + cols[j]] = cvalues[j];
         }
     }
 }
 
+template <typename T> __host__ __device__ T from_float(float x);
+template <> __host__ __device__ __half from_float<__half>(float x) { return __float2half(x); }
+#ifdef WITH_BF16
+template <> __host__ __device__ __nv_bfloat16 from_float<__nv_bfloat16>(float x) { return __float2bfloat16(x); }
+#endif
+
+template <typename T>
+__global__ void gpu_convert(const FP *src, T *dst, int len) {
+    for (int i = threadIdx.x + blockDim.x * blockIdx.x; i < len; i += blockDim.x * gridDim.x) {
+        dst[i] = from_float<T>(src[i]);
+    }
+}
+
+// Tensor-core path: T inputs (half or bfloat16), FP32 accumulation. A block of
+// (BM/WM) x (BN/WN) warps computes a BM x BN tile of c, each warp a WM x WN
+// piece made of 16x16x16 wmma fragments. Both operands go through shared
+// memory in BK-deep slices that are zero filled past the edges, and every
+// fragment is staged through shared memory so partial tiles are stored with
+// bounds checks; any n, p, m work.
+template <typename T, int BM, int BN, int BK, int WM, int WN>
+__global__ void gpu_matmul_wmma(const T *a, const T *b, FP *c, int n, int p, int m) {
+#ifndef NO_WMMA
+    const int FM = WM / 16, FN = WN / 16;
+    const int NWARPS = (BM / WM) * (BN / WN);
+    const int PAD = 8; // rows stay 32-byte aligned, but not on the same banks
+
+    __shared__ __align__(32) T atile[BM][BK + PAD];
+    __shared__ __align__(32) T btile[BK][BN + PAD];
+    __shared__ __align__(32) FP ctile[NWARPS][16 * 16];
+
+    int tid = threadIdx.x;
+    int warp = tid / 32, lane = tid % 32;
+    int wrow = (warp / (BN / WN)) * WM; // warp's piece within the block tile
+    int wcol = (warp % (BN / WN)) * WN;
+    int row0 = blockIdx.y * BM, col0 = blockIdx.x * BN;
+    T zero = from_float<T>(0.0f);
+
+    wmma::fragment<wmma::accumulator, 16, 16, 16, FP> acc[FM][FN];
+    for (int i = 0; i < FM; ++ i)
+        for (int j = 0; j < FN; ++ j)
+            wmma::fill_fragment(acc[i][j], 0.0f);
+
+    for (int k0 = 0; k0 < p; k0 += BK) {
+        for (int e = tid; e < BM * BK; e += NWARPS * 32) { //Copy to shared memory
+            int r = e / BK, k = e % BK;
+            atile[r][k] = (row0 + r < n && k0 + k < p) ? a[(row0 + r) * p + k0 + k] : zero;
+        }
+        for (int e = tid; e < BK * BN; e += NWARPS * 32) {
+            int k = e / BN, cc = e % BN;
+            btile[k][cc] = (k0 + k < p && col0 + cc < m) ? b[(k0 + k) * m + col0 + cc] : zero;
+        }
+        __syncthreads();
+
+        for (int kk = 0; kk < BK; kk += 16) {
+            wmma::fragment<wmma::matrix_a, 16, 16, 16, T, wmma::row_major> af[FM];
+            wmma::fragment<wmma::matrix_b, 16, 16, 16, T, wmma::row_major> bf[FN];
+            for (int i = 0; i < FM; ++ i)
+                wmma::load_matrix_sync(af[i], &atile[wrow + i * 16][kk], BK + PAD);
+            for (int j = 0; j < FN; ++ j)
+                wmma::load_matrix_sync(bf[j], &btile[kk][wcol + j * 16], BN + PAD);
+            for (int i = 0; i < FM; ++ i)
+                for (int j = 0; j < FN; ++ j)
+                    wmma::mma_sync(acc[i][j], af[i], bf[j], acc[i][j]);
+        }
+        __syncthreads();
+    }
+
+    // copy back to results, one fragment at a time through the warp's staging tile
+    for (int i = 0; i < FM; ++ i) {
+        for (int j = 0; j < FN; ++ j) {
+            wmma::store_matrix_sync(ctile[warp], acc[i][j], 16, wmma::mem_row_major);
+            __syncwarp();
+            for (int e = lane; e < 16 * 16; e += 32) {
+                int row = row0 + wrow + i * 16 + e / 16;
+                int col = col0 + wcol + j * 16 + e % 16;
+                if (row < n && col < m) c[row * m + col] = ctile[warp][e];
+            }
+            __syncwarp();
+        }
+    }
+#endif
+}
+
+void check_launch(const char *name) {
+    cudaError_t errorcode = cudaGetLastError();
+    if (errorcode != cudaSuccess) {
+        printf("%s failed: %s\n", name, cudaGetErrorString(errorcode));
+        exit(-1);
+    }
+}
+
+// Tile shapes; each launch below instantiates its kernel with these.
+const int TW = 32, TH = 7;                                    // FP32: 32x32 threads, 7 tiles per thread
+const int WMMA_BM = 128, WMMA_BN = 128, WMMA_BK = 32;         // block tile of c and its k slice
+const int WMMA_WM = 64, WMMA_WN = 32;                         // one warp's piece, 8 warps per block
+
+const int NSTREAMS = 3; // per GPU in batched mode: copy in, multiply and copy out of three tiles overlap
+const int MAX_GPUS = 16;
+
+void launch_tiled(const FP *a, const FP *b, FP *c, int n, int p, int m, cudaStream_t stream) {
+    dim3 Grid((m + TW * TH - 1) / (TW * TH), (n + TW - 1) / TW);
+    dim3 Block(TW, TW);
+    gpu_matmul_tiled<TW, TH> << < Grid, Block, 0, stream >> > (a, b, c, n, p, m);
+}
+
+template <typename T>
+void launch_wmma(const T *a, const T *b, FP *c, int n, int p, int m, cudaStream_t stream) {
+    dim3 Grid((m + WMMA_BN - 1) / WMMA_BN, (n + WMMA_BM - 1) / WMMA_BM);
+    dim3 Block((WMMA_BM / WMMA_WM) * (WMMA_BN / WMMA_WN) * 32);
+    gpu_matmul_wmma<T, WMMA_BM, WMMA_BN, WMMA_BK, WMMA_WM, WMMA_WN> << < Grid, Block, 0, stream >> >
+        (a, b, c, n, p, m);
+}
+
+double wall_time() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+float run_tiled(const FP *dev_a, const FP *dev_b, FP *dev_c, int n, int p, int m) {
+    cudaEvent_t start, stop;
+    float elapsed_time_ms;
+
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+    cudaFuncSetCacheConfig(gpu_matmul_tiled<TW, TH>, cudaFuncCachePreferShared);
+
+    cudaEventRecord(start, 0);
+    launch_tiled(dev_a, dev_b, dev_c, n, p, m, 0);
+    cudaEventRecord(stop, 0);
+    cudaEventSynchronize(stop);
+    check_launch("gpu_matmul_tiled");
+    cudaEventElapsedTime(&elapsed_time_ms, start, stop);
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    return elapsed_time_ms;
+}
+
+// Rounds a and b to T on the device, then times the tensor-core kernel alone.
+template <typename T>
+float run_wmma(const FP *dev_a, const FP *dev_b, FP *dev_c, int n, int p, int m) {
+    cudaEvent_t start, stop;
+    float elapsed_time_ms;
+    T *dev_ah, *dev_bh;
+
+    cudaMalloc((void **) &dev_ah, (size_t) n * p * sizeof(T));
+    cudaMalloc((void **) &dev_bh, (size_t) p * m * sizeof(T));
+    gpu_convert<T> << < 1024, 256 >> > (dev_a, dev_ah, n * p);
+    gpu_convert<T> << < 1024, 256 >> > (dev_b, dev_bh, p * m);
+    check_launch("gpu_convert");
+
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    cudaEventRecord(start, 0);
+    launch_wmma<T>(dev_ah, dev_bh, dev_c, n, p, m, 0);
+    cudaEventRecord(stop, 0);
+    cudaEventSynchronize(stop);
+    check_launch("gpu_matmul_wmma");
+    cudaEventElapsedTime(&elapsed_time_ms, start, stop);
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+    cudaFree(dev_ah);
+    cudaFree(dev_bh);
+    return elapsed_time_ms;
+}
+
+// ------------------------- BATCHED MODE -------------------------------
+// c is cut into tile x tile blocks. Each block needs a row panel of a and a
+// column panel of b; both are copied from pinned host memory, multiplied and
+// the block copied back, all asynchronously on one stream. Blocks are dealt
+// round robin over NSTREAMS streams on every GPU, so the copies of one block
+// overlap the multiplies of others, and only a few panels have to fit on a
+// device at a time. A slot skips the copy of a panel it already holds.
+
+// Device buffers of one stream; T copies are only used by the tensor-core path.
+struct Slot {
+    int dev;
+    cudaStream_t stream;
+    FP *a, *b, *c;
+    void *ah, *bh;
+    int arow, bcol; // first row / col of the panels held, -1 if none
+};
+
+// bytes per element the inputs take besides FP: rounded copies for tensor cores
+template <typename T> struct Rounded { enum { bytes = sizeof(T) }; };
+template <> struct Rounded<FP> { enum { bytes = 0 }; };
+
+template <typename T>
+void launch_tile(Slot &s, int n, int p, int m, bool fresh_a, bool fresh_b) {
+    if (fresh_a) gpu_convert<T> << < 256, 256, 0, s.stream >> > (s.a, (T *) s.ah, n * p);
+    if (fresh_b) gpu_convert<T> << < 256, 256, 0, s.stream >> > (s.b, (T *) s.bh, p * m);
+    launch_wmma<T>((const T *) s.ah, (const T *) s.bh, s.c, n, p, m, s.stream);
+}
+
+template <>
+void launch_tile<FP>(Slot &s, int n, int p, int m, bool fresh_a, bool fresh_b) {
+    launch_tiled(s.a, s.b, s.c, n, p, m, s.stream);
+}
+
+size_t slot_bytes(int tn, int tm, int p, size_t rounded) {
+    return ((size_t) tn * p + (size_t) p * tm) * (sizeof(FP) + rounded) + (size_t) tn * tm * sizeof(FP);
+}
+
+// a, b and c must be pinned. tile <= 0 picks the largest power of two up to
+// 8192 that fits NSTREAMS slots in 80% of the free memory of every GPU and
+// still gives each stream two blocks. Returns wall time, transfers included.
+template <typename T>
+float run_batched(const FP *a, const FP *b, FP *c, int n, int p, int m,
+                  const int devs[], int ndev, int tile) {
+    int nslots = ndev * NSTREAMS;
+    int d, k, i0, j0, tn, tm, nt;
+    size_t freemem, total, budget = (size_t) -1;
+    Slot *slots;
+    double wct;
+
+    if (tile <= 0) {
+        for (d = 0; d < ndev; ++ d) {
+            cudaSetDevice(devs[d]);
+            cudaMemGetInfo(&freemem, &total);
+            if (freemem < budget) budget = freemem;
+        }
+        budget = budget / 10 * 8 / NSTREAMS;
+        tile = 8192;
+        while (tile > 256 && (slot_bytes(tile < n ? tile : n, tile < m ? tile : m, p, Rounded<T>::bytes) > budget
+                              || (long) ((n + tile - 1) / tile) * ((m + tile - 1) / tile) < 2 * nslots)) {
+            tile /= 2;
+        }
+        if (slot_bytes(tile < n ? tile : n, tile < m ? tile : m, p, Rounded<T>::bytes) > budget) {
+            printf("Error, panels of %d x %d do not fit on the GPU\n", tile, p);
+            exit(-1);
+        }
+    }
+    tn = tile < n ? tile : n;
+    tm = tile < m ? tile : m;
+    printf("Batched: %d x %d tiles of c, %d streams on each of %d GPU(s)\n", tn, tm, NSTREAMS, ndev);
+
+    slots = (Slot *) malloc(nslots * sizeof(Slot));
+    for (k = 0; k < nslots; ++ k) {
+        Slot &s = slots[k];
+        s.dev = devs[k % ndev]; // neighbouring blocks go to different GPUs
+        cudaSetDevice(s.dev);
+        cudaStreamCreate(&s.stream);
+        cudaMalloc((void **) &s.a, (size_t) tn * p * sizeof(FP));
+        cudaMalloc((void **) &s.b, (size_t) p * tm * sizeof(FP));
+        cudaMalloc((void **) &s.c, (size_t) tn * tm * sizeof(FP));
+        s.ah = s.bh = NULL;
+        if (Rounded<T>::bytes > 0) {
+            cudaMalloc(&s.ah, (size_t) tn * p * Rounded<T>::bytes);
+            cudaMalloc(&s.bh, (size_t) p * tm * Rounded<T>::bytes);
+        }
+        s.arow = s.bcol = -1;
+    }
+    check_launch("slot allocation");
+
+    wct = wall_time();
+    nt = 0;
+    for (i0 = 0; i0 < n; i0 += tile) {
+        for (j0 = 0; j0 < m; j0 += tile, ++ nt) {
+            Slot &s = slots[nt % nslots];
+            int bn = (n - i0 < tile) ? n - i0 : tile;
+            int bm = (m - j0 < tile) ? m - j0 : tile;
+            bool fresh_a = s.arow != i0, fresh_b = s.bcol != j0;
+            cudaSetDevice(s.dev);
+            if (fresh_a) {
+                cudaMemcpyAsync(s.a, a + (size_t) i0 * p, (size_t) bn * p * sizeof(FP),
+                                cudaMemcpyHostToDevice, s.stream);
+            }
+            if (fresh_b) {
+                cudaMemcpy2DAsync(s.b, bm * sizeof(FP), b + j0, (size_t) m * sizeof(FP),
+                                  bm * sizeof(FP), p, cudaMemcpyHostToDevice, s.stream);
+            }
+            s.arow = i0;
+            s.bcol = j0;
+            launch_tile<T>(s, bn, p, bm, fresh_a, fresh_b);
+            cudaMemcpy2DAsync(c + (size_t) i0 * m + j0, (size_t) m * sizeof(FP), s.c, bm * sizeof(FP),
+                              bm * sizeof(FP), bn, cudaMemcpyDeviceToHost, s.stream);
+        }
+    }
+    for (d = 0; d < ndev; ++ d) {
+        cudaSetDevice(devs[d]);
+        cudaDeviceSynchronize();
+        check_launch("batched matmul");
+    }
+    wct = wall_time() - wct;
+
+    for (k = 0; k < nslots; ++ k) {
+        cudaSetDevice(slots[k].dev);
+        cudaFree(slots[k].a);
+        cudaFree(slots[k].b);
+        cudaFree(slots[k].c);
+        cudaFree(slots[k].ah);
+        cudaFree(slots[k].bh);
+        cudaStreamDestroy(slots[k].stream);
+    }
+    free(slots);
+    cudaSetDevice(devs[0]);
+    return wct * 1e3;
+}
+
 int main(int argc, char *argv[]) {
 
-    int i, j; // loop counters
+    int i, j, k; // loop counters
 
     int gpucount = 0; // Count of available GPUs
-    int gpunum = 0; // Device number to use
+    int devs[MAX_GPUS], ndev = 0; // Device numbers to use, the first one unless batched
+    int tile = 0; // batched mode tile size, 0 picks one
 
     int n, p, m; // matrix dimension
     FP *a, *b, *c; // 1d-array representing matrices, where a(nxp), b(pxm), c(nxm).
     FP *dev_a, *dev_b, *dev_c;
+    const char *precision = "fp32"; // input precision: fp32, fp16 or bf16
+    bool batched;
+    size_t bytes, rounded, freemem, total;
 
-    cudaEvent_t start, stop; // using cuda events to measure time
-    float elapsed_time_ms; // which is applicable for asynchronous code also
+    cudaDeviceProp prop;
+    float elapsed_time_ms;
     cudaError_t errorcode;
 
     // --------------------SET PARAMETERS AND DATA -----------------------
@@ -75,7 +404,8 @@ int main(int argc, char *argv[]) {
     }
 
     if ((argc < 4) || (argc > 7)) {
-        printf("Usage: matmul <matrix dim> <block dim> <grid dim> [<dev num>]\n");
+        printf("Usage: task3 <n> <p> <m> [<dev num>[,<dev num>...]] [fp32|fp16|bf16] [<tile>]\n");
+        printf("       several devices or a tile size (0 for automatic) select the batched mode\n");
         exit(-1);
     }
 
@@ -83,91 +413,151 @@ int main(int argc, char *argv[]) {
     p = atoi(argv[2]);
     m = atoi(argv[3]);
 
-    if (argc == 5) {
-        gpunum = atoi(argv[4]); // Device number
-        if ((gpunum > 2) || (gpunum < 0)) {
-            printf("Error, Device number must be 0, 1, or 2\n");
-            exit(-1);
+    if (argc >= 5) {
+        for (char *tok = strtok(argv[4], ","); tok != NULL; tok = strtok(NULL, ",")) {
+            int gpunum = atoi(tok); // Device number
+            if ((gpunum >= gpucount) || (gpunum < 0) || ndev == MAX_GPUS) {
+                printf("Error, Device numbers must be between 0 and %d\n", gpucount - 1);
+                exit(-1);
+            }
+            devs[ndev ++] = gpunum;
         }
     }
-    cudaSetDevice(gpunum);
-    printf("Using device %d\n", gpunum);
-
-    int Grid_dim_x, Grid_dim_y;
-    int Block_dim_x, Block_dim_y;
-
-    Block_dim_x = Block_dim_y = TW;
-    Grid_dim_x = m / Block_dim_x / TH;
-    Grid_dim_y = n / Block_dim_y;
+    if (ndev == 0) devs[ndev ++] = 0;
+    if (argc >= 6) precision = argv[5];
+    if (argc == 7) tile = atoi(argv[6]);
+    cudaSetDevice(devs[0]);
+    cudaGetDeviceProperties(&prop, devs[0]);
+    printf("Using device %d (compute capability %d.%d), %s inputs\n", devs[0], prop.major, prop.minor, precision);
+
+    if (prop.major * 10 + prop.minor < 30) {
+        printf("Error, task3 is built for compute capability 3.0 or later\n");
+        exit(-1);
+    }
+    if (strcmp(precision, "fp16") == 0 && prop.major < WMMA_ARCH / 100) {
+        printf("Error, fp16 tensor cores of this build need compute capability %d.0 or later\n", WMMA_ARCH / 100);
+        exit(-1);
+    }
+#ifdef WITH_BF16
+    if (strcmp(precision, "bf16") == 0 && prop.major < 8) {
+        printf("Error, bf16 tensor cores need compute capability 8.0 or later\n");
+        exit(-1);
+    }
+#else
+    if (strcmp(precision, "bf16") == 0) {
+        printf("Error, bf16 support was not compiled in (make task3 BF16=1)\n");
+        exit(-1);
+    }
+#endif
+    if (strcmp(precision, "fp32") != 0 && strcmp(precision, "fp16") != 0 && strcmp(precision, "bf16") != 0) {
+        printf("Error, precision must be fp32, fp16 or bf16\n");
+        exit(-1);
+    }
 
-    printf("Matrix Dimension = %d x %d\n", n, m);
-    printf("Block_Dim = %d x %d, Grid_Dim = %d x %d\n", Block_dim_x, Block_dim_y, Grid_dim_x, Grid_dim_y);
+    // whole matrices on the device, plus rounded copies of a and b for tensor cores
+    rounded = strcmp(precision, "fp32") == 0 ? 0 : 2;
+    bytes = ((size_t) n * p + (size_t) p * m) * (sizeof(FP) + rounded) + (size_t) n * m * sizeof(FP);
+    cudaMemGetInfo(&freemem, &total);
+    batched = ndev > 1 || argc == 7 || bytes > freemem / 10 * 9;
 
-    dim3 Grid(Grid_dim_x, Grid_dim_y); //Grid structure
-    dim3 Block(Block_dim_x, Block_dim_y); //Block structure
+    printf("Matrix Dimension = %d x %d x %d\n", n, p, m);
 
-    a = (FP *) malloc(n * p * sizeof(FP)); // dynamically allocated memory for arrays on host
-    b = (FP *) malloc(p * m * sizeof(FP));
-    c = (FP *) malloc(n * m * sizeof(FP)); // results from GPU
+    if (batched) { // page-locked, so the async copies really overlap
+        cudaHostAlloc((void **) &a, (size_t) n * p * sizeof(FP), cudaHostAllocPortable);
+        cudaHostAlloc((void **) &b, (size_t) p * m * sizeof(FP), cudaHostAllocPortable);
+        cudaHostAlloc((void **) &c, (size_t) n * m * sizeof(FP), cudaHostAllocPortable);
+        check_launch("cudaHostAlloc");
+    } else {
+        a = (FP *) malloc((size_t) n * p * sizeof(FP)); // dynamically allocated memory for arrays on host
+        b = (FP *) malloc((size_t) p * m * sizeof(FP));
+        c = (FP *) malloc((size_t) n * m * sizeof(FP)); // results from GPU
+    }
 
     srand(12345);
     for (i = 0; i < n; i++)
         for (j = 0; j < p; j++) {
-            a[i * p + j] = (FP) rand() / (FP) RAND_MAX;
+            a[(size_t) i * p + j] = (FP) rand() / (FP) RAND_MAX;
             // a[i * p + j] = (FP) i + j; // may be helpful for debugging
         }
 
     for (i = 0; i < p; i++)
         for (j = 0; j < m; j++) {
-            b[i * m + j] = (FP) rand() / (FP) RAND_MAX;
+            b[(size_t) i * m + j] = (FP) rand() / (FP) RAND_MAX;
             // b[i * m + j] = (FP) i + j; // may be helpful for debugging
         }
 
     // ------------- COMPUTATION DONE ON GPU ----------------------------
 
-    cudaMalloc((void **) &dev_a, n * p * sizeof(FP)); // allocate memory on device
-    cudaMalloc((void **) &dev_b, p * m * sizeof(FP));
-    cudaMalloc((void **) &dev_c, n * m * sizeof(FP));
-
-    cudaMemcpy(dev_a, a, n * p * sizeof(FP), cudaMemcpyHostToDevice);
-    cudaMemcpy(dev_b, b, p * m * sizeof(FP), cudaMemcpyHostToDevice);
-
-    cudaEventCreate(&start); // instrument code to measure start time
-    cudaEventCreate(&stop);
-
-    cudaEventRecord(start, 0);
-
-    // cudaFuncSetCacheConfig(gpu_matmul_tiled, cudaFuncCachePreferL1);
-    cudaFuncSetCacheConfig(gpu_matmul_tiled, cudaFuncCachePreferShared);
-
-    gpu_matmul_tiled << < Grid, Block >> > (dev_a, dev_b, dev_c, n, p, m);
-
-    cudaEventRecord(stop, 0); // instrument code to measure end time
-    cudaEventSynchronize(stop);
-    cudaEventElapsedTime(&elapsed_time_ms, start, stop);
+    if (batched) {
+        if (strcmp(precision, "fp16") == 0) {
+            elapsed_time_ms = run_batched<__half>(a, b, c, n, p, m, devs, ndev, tile);
+#ifdef WITH_BF16
+        } else if (strcmp(precision, "bf16") == 0) {
+            elapsed_time_ms = run_batched<__nv_bfloat16>(a, b, c, n, p, m, devs, ndev, tile);
+#endif
+        } else {
+            elapsed_time_ms = run_batched<FP>(a, b, c, n, p, m, devs, ndev, tile);
+        }
+    } else {
+        cudaMalloc((void **) &dev_a, (size_t) n * p * sizeof(FP)); // allocate memory on device
+        cudaMalloc((void **) &dev_b, (size_t) p * m * sizeof(FP));
+        cudaMalloc((void **) &dev_c, (size_t) n * m * sizeof(FP));
+
+        cudaMemcpy(dev_a, a, (size_t) n * p * sizeof(FP), cudaMemcpyHostToDevice);
+        cudaMemcpy(dev_b, b, (size_t) p * m * sizeof(FP), cudaMemcpyHostToDevice);
+
+        if (strcmp(precision, "fp16") == 0) {
+            elapsed_time_ms = run_wmma<__half>(dev_a, dev_b, dev_c, n, p, m);
+#ifdef WITH_BF16
+        } else if (strcmp(precision, "bf16") == 0) {
+            elapsed_time_ms = run_wmma<__nv_bfloat16>(dev_a, dev_b, dev_c, n, p, m);
+#endif
+        } else {
+            elapsed_time_ms = run_tiled(dev_a, dev_b, dev_c, n, p, m);
+        }
 
-    cudaMemcpy(c, dev_c, n * m * sizeof(FP), cudaMemcpyDeviceToHost);
+        cudaMemcpy(c, dev_c, (size_t) n * m * sizeof(FP), cudaMemcpyDeviceToHost);
+        cudaFree(dev_a);
+        cudaFree(dev_b);
+        cudaFree(dev_c);
+    }
 
     // Printing out diagonal to validate correctness
-    for (i = 0; i < n; i+=32) {
-        printf("%f ", c[i * m + i]);
+    for (i = 0; i < n && i < m; i+=32) {
+        printf("%f ", c[(size_t) i * m + i]);
         // }
     }
     printf("\n");
 
-    printf("Time to calculate results on GPU: %f ms.\n", elapsed_time_ms); // exec. time
+    printf("Time to calculate results on GPU: %f ms (%.1lf GFLOP/s).\n", elapsed_time_ms,
+           2.0 * n * p * m / elapsed_time_ms / 1e6); // exec. time
 
-// -------------- clean up ---------------------------------------
+    // ------------------- check a sample of entries against the host -----------------
+
+    double error = 0., ref, got;
+    int samples = 0;
+    for (i = 0; i < n; i += 1 + n / 64) {
+        for (j = (i * 7) % m; j < m; j += 1 + m / 64) {
+            ref = 0.;
+            for (k = 0; k < p; ++ k) ref += (double) a[(size_t) i * p + k] * b[(size_t) k * m + j];
+            got = c[(size_t) i * m + j];
+            if (fabs(got - ref) / ref > error) error = fabs(got - ref) / ref;
+            samples ++;
+        }
+    }
+    printf("Max relative error over %d sampled entries: %e\n", samples, error);
 
-    free(a);
-    free(b);
-    free(c);
-    cudaFree(dev_a);
-    cudaFree(dev_b);
-    cudaFree(dev_c);
+// -------------- clean up ---------------------------------------
 
-    cudaEventDestroy(start);
-    cudaEventDestroy(stop);
+    if (batched) {
+        cudaFreeHost(a);
+        cudaFreeHost(b);
+        cudaFreeHost(c);
+    } else {
+        free(a);
+        free(b);
+        free(c);
+    }
 
     return 0;
 }